@@ -0,0 +1,526 @@
+#include <stdio.h>
+#include <time.h>
+#include "mpc.h"
+#include "lbig.h"
+#include "lvec.h"
+#include "parsing.h"
+
+//=======================================================
+//                Micro Benchmarks
+//=======================================================
+
+/* Monotonic time in nanoseconds */
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Symbol lookup latency in a flat env of growing size */
+static int bench_lenv(void)
+{
+    int sizes[] = {10, 100, 1000, 10000, 100000};
+    int lookups = 1000000;
+    char name[32];
+
+    printf("%10s  %12s\n", "bindings", "ns/lookup");
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s)
+    {
+        int n = sizes[s];
+        lenv *e = lenv_new();
+        lval **keys = malloc(sizeof(lval *) * n);
+
+        for (int i = 0; i < n; ++i)
+        {
+            snprintf(name, sizeof(name), "sym%d", i);
+            keys[i] = lval_sym(name);
+            lval *v = lval_num(i);
+            lenv_def(e, keys[i], v);
+            lval_del(v);
+        }
+
+        /* Stride through keys so consecutive lookups hit different slots */
+        double start = bench_now();
+        unsigned k = 0;
+        for (int i = 0; i < lookups; ++i)
+        {
+            k = (k + 7919) % n;
+            lval_del(lenv_get_value(e, keys[k]));
+        }
+        double elapsed = bench_now() - start;
+
+        printf("%10d  %12.1f\n", n, elapsed / lookups);
+
+        for (int i = 0; i < n; ++i)
+            lval_del(keys[i]);
+        free(keys);
+        lenv_del(e);
+    }
+    return 0;
+}
+
+/* Parse and evaluate src in e */
+static lval *bench_eval(lenv *e, char *src)
+{
+    mpc_result_t r;
+    if (!mpc_parse("<bench>", src, lispy_parser(), &r))
+    {
+        mpc_err_print(r.error);
+        mpc_err_delete(r.error);
+        return lval_err("parse error");
+    }
+    return lval_eval(e, r.output);
+}
+
+/* Calls to recursive lambdas, tree-walking vs compiled bodies */
+static int bench_calls(void)
+{
+    char *defs[] = {
+        "def {fib} (\\ {n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n 2))}})",
+        "def {ack} (\\ {m n} {if (== m 0) {+ n 1} "
+        "{if (== n 0) {ack (- m 1) 1} {ack (- m 1) (ack m (- n 1))}}})",
+        "def {add3} (\\ {x y z} {+ x y z})",
+        "def {curried} (\\ {n} {if (== n 0) {0} {+ (((add3 n) 1) 2) (curried (- n 1))}})",
+        "def {setl} (\\ {n} {= {t} n})",
+        "def {locals} (\\ {n acc} {if (== n 0) {acc} {locals (- n 1) (+ acc (len (list (setl n))))}})",
+        "def {evals} (\\ {n acc} {if (== n 0) {acc} {evals (- n 1) (eval {+ acc n})}})",
+        "def {pick} (\\ {n a b} {if (% n 2) a b})",
+        "def {picks} (\\ {n acc} {if (== n 0) {acc} {picks (- n 1) (+ acc (pick n {* n 3} {- n}))}})",
+    };
+    char *calls[] = {"fib 22", "ack 2 200", "curried 2000", "locals 100000 0", "evals 100000 0", "picks 100000 0"};
+
+    lenv *e = lenv_new();
+    lenv_add_builtins(e);
+    for (int i = 0; i < (int)(sizeof(defs) / sizeof(defs[0])); ++i)
+        lval_del(bench_eval(e, defs[i]));
+
+    printf("%16s  %12s  %12s  %8s\n", "call", "tree ms", "vm ms", "speedup");
+    for (int i = 0; i < (int)(sizeof(calls) / sizeof(calls[0])); ++i)
+    {
+        double ms[2];
+        for (int vm = 0; vm < 2; ++vm)
+        {
+            lvm_enabled = vm;
+            double start = bench_now();
+            lval *v = bench_eval(e, calls[i]);
+            ms[vm] = (bench_now() - start) / 1e6;
+            lval_del(v);
+        }
+        printf("%16s  %12.1f  %12.1f  %7.1fx\n", calls[i], ms[0], ms[1], ms[0] / ms[1]);
+    }
+    lvm_enabled = 1;
+    lenv_del(e);
+    return 0;
+}
+
+/* Calls through small helpers and constant arithmetic, with and without the optimizing pass */
+static int bench_opt(void)
+{
+    char *defs[] = {
+        "def {sq} (\\ {x} {* x x})",
+        "def {day} (\\ {d} {* d (* 60 60 24)})",
+        "def {norm} (\\ {x y} {+ (sq x) (sq y)})",
+        "def {walk} (\\ {n acc} {if (== n 0) {acc} {walk (- n 1) (+ acc (norm n (day 1)))}})",
+    };
+    char *call = "walk 20000 0";
+
+    printf("%8s  %12s  %12s  %8s\n", "eval", "plain ms", "opt ms", "speedup");
+    for (int vm = 0; vm < 2; ++vm)
+    {
+        double ms[2];
+        lvm_enabled = vm;
+        for (int opt = 0; opt < 2; ++opt)
+        {
+            /* Fresh definitions, so no body is left over from the other setting */
+            lopt_enabled = opt;
+            lenv *e = lenv_new();
+            lenv_add_builtins(e);
+            for (int i = 0; i < (int)(sizeof(defs) / sizeof(defs[0])); ++i)
+                lval_del(bench_eval(e, defs[i]));
+
+            double start = bench_now();
+            lval_del(bench_eval(e, call));
+            ms[opt] = (bench_now() - start) / 1e6;
+            lenv_del(e);
+        }
+        printf("%8s  %12.1f  %12.1f  %7.1fx\n", vm ? "vm" : "tree", ms[0], ms[1], ms[0] / ms[1]);
+    }
+    lvm_enabled = 1;
+    lopt_enabled = 0;
+    return 0;
+}
+
+/* Variadic + and * over argument lists of growing length */
+static int bench_ops(void)
+{
+    int sizes[] = {4, 64, 1024, 16384};
+    long elements = 20000000;
+    lbuiltin ops[] = {builtin_add, builtin_mul};
+
+    printf("%10s  %12s  %12s\n", "args", "+ ns/arg", "* ns/arg");
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s)
+    {
+        int n = sizes[s];
+        lval *args = lval_sexpr();
+        for (int i = 0; i < n; ++i)
+            lval_add_tail(args, lval_num(1.0 + (i & 1) * 1e-9));
+
+        double ns[2];
+        long reps = elements / n;
+        for (int o = 0; o < 2; ++o)
+        {
+            double start = bench_now();
+            for (long r = 0; r < reps; ++r)
+                lval_del(ops[o](NULL, lval_copy(args)));
+            ns[o] = (bench_now() - start) / ((double)reps * n);
+        }
+        printf("%10d  %12.2f  %12.2f\n", n, ns[0], ns[1]);
+        lval_del(args);
+    }
+    return 0;
+}
+
+/* Random positive integer of the given number of decimal digits */
+static lbig *bench_big(int digits, unsigned *seed)
+{
+    char *s = malloc(digits + 1);
+    for (int i = 0; i < digits; ++i)
+    {
+        *seed = *seed * 1103515245u + 12345u;
+        s[i] = (char)('0' + (*seed >> 16) % 10);
+    }
+    s[0] = s[0] == '0' ? '1' : s[0];
+    s[digits] = '\0';
+
+    lbig *a = lbig_from_str(s);
+    free(s);
+    return a;
+}
+
+/* Karatsuba against schoolbook multiplication of equal sized operands */
+static int bench_bignum(void)
+{
+    int sizes[] = {100, 1000, 10000, 100000};
+    unsigned seed = 1;
+
+    printf("%10s  %14s  %14s  %8s\n", "digits", "school ms", "karatsuba ms", "speedup");
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s)
+    {
+        lbig *a = bench_big(sizes[s], &seed);
+        lbig *b = bench_big(sizes[s], &seed);
+        int reps = sizes[s] >= 10000 ? 3 : 100000 / sizes[s];
+
+        lbig *r[2];
+        double ms[2];
+        for (int k = 0; k < 2; ++k)
+        {
+            double start = bench_now();
+            for (int i = 0; i < reps; ++i)
+            {
+                r[k] = k ? lbig_mul(a, b) : lbig_mul_school(a, b);
+                if (i + 1 < reps)
+                    lbig_del(r[k]);
+            }
+            ms[k] = (bench_now() - start) / 1e6 / reps;
+        }
+
+        if (lbig_cmp(r[0], r[1]) != 0)
+            printf("%10d  products differ\n", sizes[s]);
+        else
+            printf("%10d  %14.3f  %14.3f  %7.1fx\n", sizes[s], ms[0], ms[1], ms[0] / ms[1]);
+
+        lbig_del(r[0]);
+        lbig_del(r[1]);
+        lbig_del(a);
+        lbig_del(b);
+    }
+    return 0;
+}
+
+/* Element-wise and reducing operations on million element vectors */
+static int bench_vec(void)
+{
+    int n = 1000000;
+    int reps = 50;
+    lvec *x = lvec_new(LVEC_F64, n);
+    lvec *y = lvec_new(LVEC_F64, n);
+    lval *cells = lval_sexpr();
+    for (int i = 0; i < n; ++i)
+    {
+        x->f64[i] = i * 0.5;
+        y->f64[i] = n - i;
+        lval_add_tail(cells, lval_num(x->f64[i]));
+    }
+    lval *a = lval_vec(x);
+    lval *b = lval_vec(y);
+
+    printf("%24s  %10s  %10s\n", "operation", "ms", "GB/s");
+
+    /* Two inputs read and a new result written */
+    double start = bench_now();
+    for (int i = 0; i < reps; ++i)
+    {
+        lval *args = lval_add_tail(lval_add_tail(lval_sexpr(), lval_copy(a)), lval_copy(b));
+        lval_del(builtin_add(NULL, args));
+    }
+    double ms = (bench_now() - start) / 1e6 / reps;
+    printf("%24s  %10.3f  %10.2f\n", "+ vec vec", ms, 3.0 * n * 8 / ms / 1e6);
+
+    /* An unshared left operand is overwritten in place */
+    lval *acc = lval_vec(lvec_copy(x));
+    start = bench_now();
+    for (int i = 0; i < reps; ++i)
+    {
+        lval *args = lval_add_tail(lval_add_tail(lval_sexpr(), acc), lval_copy(b));
+        acc = builtin_add(NULL, args);
+    }
+    ms = (bench_now() - start) / 1e6 / reps;
+    printf("%24s  %10.3f  %10.2f\n", "+ vec vec, in place", ms, 3.0 * n * 8 / ms / 1e6);
+    lval_del(acc);
+
+    start = bench_now();
+    for (int i = 0; i < reps; ++i)
+        lval_del(builtin_dot(NULL, lval_add_tail(lval_add_tail(lval_sexpr(), lval_copy(a)), lval_copy(b))));
+    ms = (bench_now() - start) / 1e6 / reps;
+    printf("%24s  %10.3f  %10.2f\n", "dot", ms, 2.0 * n * 8 / ms / 1e6);
+
+    start = bench_now();
+    for (int i = 0; i < reps; ++i)
+        lval_del(builtin_vsum(NULL, lval_add_tail(lval_sexpr(), lval_copy(a))));
+    ms = (bench_now() - start) / 1e6 / reps;
+    printf("%24s  %10.3f  %10.2f\n", "vsum", ms, 1.0 * n * 8 / ms / 1e6);
+
+    /* The same sum over a list of boxed numbers */
+    start = bench_now();
+    for (int i = 0; i < reps; ++i)
+        lval_del(builtin_add(NULL, lval_copy(cells)));
+    ms = (bench_now() - start) / 1e6 / reps;
+    printf("%24s  %10.3f  %10s\n", "+ over boxed numbers", ms, "-");
+
+    lval_del(cells);
+    lval_del(a);
+    lval_del(b);
+    return 0;
+}
+
+/* Per-operation cost of growing and shrinking lists of growing size */
+static int bench_lists(void)
+{
+    int sizes[] = {1000, 10000, 100000};
+
+    printf("%10s  %12s  %12s  %12s  %12s  %12s  %12s\n", "length", "append ns", "pop-front ns", "cons ns",
+           "join ns", "tail ns", "queue ns");
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s)
+    {
+        int n = sizes[s];
+        double ns[6];
+
+        lval *v = lval_qexpr();
+        double start = bench_now();
+        for (int i = 0; i < n; ++i)
+            v = lval_add_tail(v, lval_int(i));
+        ns[0] = (bench_now() - start) / n;
+
+        start = bench_now();
+        while (v->count)
+            lval_del(lval_pop(v, 0));
+        ns[1] = (bench_now() - start) / n;
+
+        start = bench_now();
+        for (int i = 0; i < n; ++i)
+            v = lval_add_head(v, lval_int(i));
+        ns[2] = (bench_now() - start) / n;
+
+        /* Join n one-element lists */
+        lval *args = lval_sexpr();
+        for (int i = 0; i < n; ++i)
+            args = lval_add_tail(args, lval_add_tail(lval_qexpr(), lval_int(i)));
+        start = bench_now();
+        lval *j = builtin_join(NULL, args);
+        ns[3] = (bench_now() - start) / n;
+
+        /* Walk the tails of a list that stays shared with v */
+        lval *t = lval_copy(v);
+        start = bench_now();
+        while (t->count)
+            t = builtin_tail(NULL, lval_add_tail(lval_sexpr(), t));
+        ns[4] = (bench_now() - start) / n;
+        lval_del(t);
+
+        /*
+         * Slide a list along, dropping the front and joining at the back,
+         * while the previous list is still held as a call's argument is.
+         * It is one short of a power of two, so blocks fill up quickest.
+         */
+        int m = 1;
+        while (m < n)
+            m *= 2;
+        lval *q = lval_qexpr();
+        for (int i = 1; i < m; ++i)
+            q = lval_add_tail(q, lval_int(i));
+        start = bench_now();
+        for (int i = 0; i < n; ++i)
+        {
+            lval *t = builtin_tail(NULL, lval_add_tail(lval_sexpr(), lval_copy(q)));
+            lval *a = lval_add_tail(lval_add_tail(lval_sexpr(), t), lval_add_tail(lval_qexpr(), lval_int(i)));
+            lval_del(q);
+            q = builtin_join(NULL, a);
+        }
+        ns[5] = (bench_now() - start) / n;
+        lval_del(q);
+
+        printf("%10d  %12.1f  %12.1f  %12.1f  %12.1f  %12.1f  %12.1f\n", n, ns[0], ns[1], ns[2], ns[3], ns[4],
+               ns[5]);
+        lval_del(j);
+        lval_del(v);
+    }
+    return 0;
+}
+
+/*
+ * Throughput and pauses with per-form regions, and with regions also
+ * collected while a form runs, against reference counting alone. The
+ * last form runs long enough for a region to grow without bound.
+ */
+static int bench_gc(void)
+{
+    char *defs[] = {
+        "def {fib} (\\ {n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n 2))}})",
+        "def {build} (\\ {n acc} {if (== n 0) {acc} {build (- n 1) (cons n acc)}})",
+        "def {kept} {}",
+        "def {spin} (\\ {n} {if (== n 0) {0} {spin (+ (- n 1) (* 0 (len (build 20 {}))))}})",
+    };
+    char *forms[] = {"fib 16", "len (build 2000 {})", "def {kept} (build 200 {})", "spin 20000"};
+    int reps[] = {200, 200, 200, 5};
+    char *modes[] = {"refcount", "region", "gc"};
+
+    printf("%28s  %8s  %10s  %14s  %14s  %10s  %10s  %12s\n",
+           "form", "mode", "forms/s", "pause avg us", "pause max us", "promoted", "peak KB", "collections");
+    for (int i = 0; i < (int)(sizeof(forms) / sizeof(forms[0])); ++i)
+    {
+        for (int mode = 0; mode < 3; ++mode)
+        {
+            lgc.enabled = mode == 2;
+            lenv *e = lenv_new();
+            lenv_add_builtins(e);
+            for (int d = 0; d < (int)(sizeof(defs) / sizeof(defs[0])); ++d)
+                lval_del(bench_eval(e, defs[d]));
+
+            lform_stat stat;
+            lval_region_stats(&stat);
+            double start = bench_now();
+            for (int r = 0; r < reps[i]; ++r)
+            {
+                if (mode)
+                    lval_region_begin();
+                lval_del(bench_eval(e, forms[i]));
+                if (mode)
+                    lval_region_end();
+            }
+            double elapsed = bench_now() - start;
+            lval_region_stats(&stat);
+
+            printf("%28s  %8s  %10.1f", forms[i], modes[mode], reps[i] / (elapsed / 1e9));
+            if (mode)
+            {
+                /* Pauses of a collection count along with those dropping regions */
+                double pause = (stat.pause_ns + stat.gc_ns) / (reps[i] + stat.collections);
+                double max = stat.gc_max_ns > stat.pause_max_ns ? stat.gc_max_ns : stat.pause_max_ns;
+                printf("  %14.1f  %14.1f  %10zu  %10zu  %12zu\n",
+                       pause / 1e3, max / 1e3, stat.promoted, stat.peak / 1024, stat.collections);
+            }
+            else
+                printf("  %14s  %14s  %10s  %10s  %12s\n", "-", "-", "-", "-", "-");
+            lenv_del(e);
+        }
+    }
+    lgc.enabled = 0;
+    return 0;
+}
+
+/* Reading a large source, the mpc grammar against the hand-written reader */
+static int bench_read(void)
+{
+    /* About 1MB of definitions, lists and every kind of atom */
+    char *line = "def {f%d} (\\ {x y} {if (>= x -%d) {* x 2.5 y} {^ (%% x 7) 123456789012345678901234567890}})\n";
+    size_t cap = 1 << 20, len = 0;
+    char *src = malloc(cap + 256);
+    for (int i = 0; len < cap; ++i)
+        len += sprintf(src + len, line, i, i);
+
+    int reps = 5;
+    lval *x[2] = {NULL, NULL};
+    double ms[2];
+    for (int k = 0; k < 2; ++k)
+    {
+        double start = bench_now();
+        for (int i = 0; i < reps; ++i)
+        {
+            lval_del(x[k]);
+            char *err = NULL;
+            mpc_result_t r;
+            if (k)
+                x[k] = lread("<bench>", src, len, 0, &err);
+            else if (mpc_parse("<bench>", src, lispy_parser(), &r))
+                x[k] = r.output;
+            else
+            {
+                err = mpc_err_string(r.error);
+                mpc_err_delete(r.error);
+                x[k] = NULL;
+            }
+            if (!x[k])
+            {
+                fputs(err, stdout);
+                free(err);
+                lval_del(x[0]);
+                free(src);
+                return 1;
+            }
+        }
+        ms[k] = (bench_now() - start) / 1e6 / reps;
+    }
+
+    printf("%10s  %10s  %10s  %8s\n", "reader", "ms", "MB/s", "speedup");
+    printf("%10s  %10.2f  %10.1f\n", "mpc", ms[0], len / 1e3 / ms[0]);
+    printf("%10s  %10.2f  %10.1f  %7.1fx\n", "lread", ms[1], len / 1e3 / ms[1], ms[0] / ms[1]);
+    if (!lval_eq(x[0], x[1]))
+        puts("readers differ");
+
+    lval_del(x[0]);
+    lval_del(x[1]);
+    free(src);
+    return 0;
+}
+
+int lispy_bench(int argc, char **argv)
+{
+    if (argc < 1)
+    {
+        puts("Usage: parsing --bench <lenv|calls|opt|ops|read|bignum|vec|lists|gc>");
+        return 1;
+    }
+
+    if (strcmp(argv[0], "lenv") == 0)
+        return bench_lenv();
+    if (strcmp(argv[0], "calls") == 0)
+        return bench_calls();
+    if (strcmp(argv[0], "opt") == 0)
+        return bench_opt();
+    if (strcmp(argv[0], "ops") == 0)
+        return bench_ops();
+    if (strcmp(argv[0], "read") == 0)
+        return bench_read();
+    if (strcmp(argv[0], "bignum") == 0)
+        return bench_bignum();
+    if (strcmp(argv[0], "vec") == 0)
+        return bench_vec();
+    if (strcmp(argv[0], "lists") == 0)
+        return bench_lists();
+    if (strcmp(argv[0], "gc") == 0)
+        return bench_gc();
+
+    printf("Unknown benchmark: %s\n", argv[0]);
+    return 1;
+}
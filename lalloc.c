@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include "lalloc.h"
+
+//=======================================================
+//                Implemention
+//=======================================================
+
+/*
+ * Objects of each size class are served from a free list owned by
+ * the calling thread. Empty lists are refilled by carving a new slab,
+ * and freed objects are pushed onto the freeing thread's list. Slabs
+ * are never returned to the system.
+ *
+ * Building with LISPY_NO_SLAB turns lalloc/lfree into plain
+ * malloc/free, so sanitizers see every object separately.
+ */
+
+typedef struct lalloc_free
+{
+    struct lalloc_free *next;
+} lalloc_free;
+
+static _Thread_local lalloc_free *lalloc_lists[LALLOC_CLASSES];
+static _Thread_local lalloc_stat lalloc_counts[LALLOC_CLASSES];
+
+static int lalloc_class(size_t size)
+{
+    return (int)((size + LALLOC_ALIGN - 1) / LALLOC_ALIGN) - 1;
+}
+
+#ifndef LISPY_NO_SLAB
+/* Carve a new slab into objects of class c */
+static void lalloc_refill(int c)
+{
+    size_t size = (size_t)(c + 1) * LALLOC_ALIGN;
+    char *slab = malloc(LALLOC_SLAB_SIZE);
+    if (!slab)
+        return;
+
+    lalloc_free *head = lalloc_lists[c];
+    for (size_t off = 0; off + size <= LALLOC_SLAB_SIZE; off += size)
+    {
+        lalloc_free *f = (lalloc_free *)(slab + off);
+        f->next = head;
+        head = f;
+    }
+    lalloc_lists[c] = head;
+    lalloc_counts[c].slabs++;
+}
+#endif
+
+/* Allocate an object of size bytes */
+void *lalloc(size_t size)
+{
+    if (size == 0 || size > LALLOC_MAX_SIZE)
+        return malloc(size);
+
+    int c = lalloc_class(size);
+    lalloc_counts[c].allocs++;
+
+#ifdef LISPY_NO_SLAB
+    return malloc(size);
+#else
+    if (!lalloc_lists[c])
+    {
+        lalloc_refill(c);
+        if (!lalloc_lists[c])
+            return NULL;
+    }
+
+    lalloc_free *f = lalloc_lists[c];
+    lalloc_lists[c] = f->next;
+    return f;
+#endif
+}
+
+/* Free an object allocated by lalloc with the same size */
+void lfree(void *p, size_t size)
+{
+    if (!p)
+        return;
+    if (size == 0 || size > LALLOC_MAX_SIZE)
+    {
+        free(p);
+        return;
+    }
+
+    int c = lalloc_class(size);
+    lalloc_counts[c].frees++;
+
+#ifdef LISPY_NO_SLAB
+    free(p);
+#else
+    lalloc_free *f = p;
+    f->next = lalloc_lists[c];
+    lalloc_lists[c] = f;
+#endif
+}
+
+/* Report the calling thread's allocation counters to hook */
+void lalloc_stats(lalloc_hook hook)
+{
+    for (int c = 0; c < LALLOC_CLASSES; ++c)
+        lalloc_counts[c].size = (size_t)(c + 1) * LALLOC_ALIGN;
+    hook(lalloc_counts, LALLOC_CLASSES);
+}
+
+/*
+ * A region hands out memory by bumping a pointer through chunks and
+ * frees everything at once in lregion_reset. One chunk is kept for
+ * reuse. With LISPY_NO_SLAB every allocation is a separate malloc
+ * so sanitizers can catch uses after a reset.
+ */
+
+#define LREGION_CHUNK_SIZE (64 * 1024)
+
+typedef struct lregion_chunk
+{
+    struct lregion_chunk *next;
+    size_t size;
+    size_t used;
+    char *base;
+} lregion_chunk;
+
+struct lregion
+{
+    lregion_chunk *head;
+    size_t used;
+};
+
+static lregion_chunk *lregion_chunk_new(size_t size)
+{
+    lregion_chunk *c = malloc(sizeof(lregion_chunk) + size);
+    if (!c)
+        return NULL;
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    c->base = (char *)(c + 1);
+    return c;
+}
+
+lregion *lregion_new(void)
+{
+    lregion *r = malloc(sizeof(lregion));
+    r->head = NULL;
+    r->used = 0;
+    return r;
+}
+
+void *lregion_alloc(lregion *r, size_t size)
+{
+    size = (size + LALLOC_ALIGN - 1) & ~(size_t)(LALLOC_ALIGN - 1);
+    r->used += size;
+
+#ifdef LISPY_NO_SLAB
+    lregion_chunk *c = lregion_chunk_new(size);
+    if (!c)
+        return NULL;
+    c->next = r->head;
+    r->head = c;
+    return c->base;
+#else
+    lregion_chunk *c = r->head;
+    if (!c || c->used + size > c->size)
+    {
+        c = lregion_chunk_new(size > LREGION_CHUNK_SIZE ? size : LREGION_CHUNK_SIZE);
+        if (!c)
+            return NULL;
+        c->next = r->head;
+        r->head = c;
+    }
+
+    void *p = c->base + c->used;
+    c->used += size;
+    return p;
+#endif
+}
+
+/* Bytes handed out since the last reset */
+size_t lregion_used(lregion *r)
+{
+    return r->used;
+}
+
+void lregion_reset(lregion *r)
+{
+    lregion_chunk *keep = NULL;
+    lregion_chunk *c = r->head;
+    while (c)
+    {
+        lregion_chunk *next = c->next;
+#ifndef LISPY_NO_SLAB
+        /* Keep one standard sized chunk around for the next form */
+        if (!keep && c->size == LREGION_CHUNK_SIZE)
+        {
+            keep = c;
+            keep->next = NULL;
+            keep->used = 0;
+            c = next;
+            continue;
+        }
+#endif
+        free(c);
+        c = next;
+    }
+    r->head = keep;
+    r->used = 0;
+}
+
+void lregion_del(lregion *r)
+{
+    lregion_reset(r);
+    free(r->head);
+    free(r);
+}
@@ -0,0 +1,40 @@
+//=============================================================
+//             Interpreter Object Allocator
+//=============================================================
+
+#include <stddef.h>
+
+/* Objects are rounded up to a multiple of this */
+#define LALLOC_ALIGN 8
+
+/* Largest object served from slabs, bigger ones go to malloc */
+#define LALLOC_MAX_SIZE 64
+#define LALLOC_CLASSES (LALLOC_MAX_SIZE / LALLOC_ALIGN)
+
+/* Bytes carved into objects at once when a free list runs dry */
+#define LALLOC_SLAB_SIZE (64 * 1024)
+
+/* Counters of one size class, kept per thread */
+typedef struct lalloc_stat
+{
+    size_t size;
+    size_t allocs;
+    size_t frees;
+    size_t slabs;
+} lalloc_stat;
+
+/* Called with the calling thread's counters of every size class */
+typedef void (*lalloc_hook)(lalloc_stat *stats, int n);
+
+void *lalloc(size_t size);
+void lfree(void *p, size_t size);
+void lalloc_stats(lalloc_hook hook);
+
+/* Bump allocator whose memory is released all at once */
+typedef struct lregion lregion;
+
+lregion *lregion_new(void);
+void *lregion_alloc(lregion *r, size_t size);
+size_t lregion_used(lregion *r);
+void lregion_reset(lregion *r);
+void lregion_del(lregion *r);
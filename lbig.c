@@ -0,0 +1,522 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lbig.h"
+
+//=======================================================
+//                Implemention
+//=======================================================
+
+/*
+ * Magnitudes are worked on as plain limb arrays, the mag_ helpers
+ * take explicit lengths and allow leading zero limbs. The lbig_
+ * functions wrap them with signs and trim the results.
+ */
+
+static lbig *lbig_alloc(int len)
+{
+    lbig *a = malloc(sizeof(lbig) + sizeof(uint32_t) * (len ? len : 1));
+    a->neg = 0;
+    a->len = len;
+    return a;
+}
+
+/* Drop leading zero limbs, zero is never negative */
+static lbig *lbig_trim(lbig *a)
+{
+    while (a->len && a->d[a->len - 1] == 0)
+        a->len--;
+    if (!a->len)
+        a->neg = 0;
+    return a;
+}
+
+lbig *lbig_from_int(int64_t x)
+{
+    /* Negate through unsigned so that INT64_MIN works */
+    uint64_t m = x < 0 ? -(uint64_t)x : (uint64_t)x;
+    lbig *a = lbig_alloc(2);
+    a->neg = x < 0;
+    a->d[0] = (uint32_t)m;
+    a->d[1] = (uint32_t)(m >> 32);
+    return lbig_trim(a);
+}
+
+lbig *lbig_copy(lbig *a)
+{
+    lbig *b = lbig_alloc(a->len);
+    b->neg = a->neg;
+    memcpy(b->d, a->d, sizeof(uint32_t) * a->len);
+    return b;
+}
+
+void lbig_del(lbig *a)
+{
+    free(a);
+}
+
+/* Compare magnitudes of the same length */
+static int mag_cmp(const uint32_t *a, const uint32_t *b, int n)
+{
+    for (int i = n - 1; i >= 0; --i)
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    return 0;
+}
+
+/* Compare the magnitudes of a and b */
+static int lbig_cmp_mag(lbig *a, lbig *b)
+{
+    if (a->len != b->len)
+        return a->len < b->len ? -1 : 1;
+    return mag_cmp(a->d, b->d, a->len);
+}
+
+/* r += a where an <= rn, returns the carry out of r */
+static uint32_t mag_add_to(uint32_t *r, int rn, const uint32_t *a, int an)
+{
+    uint64_t carry = 0;
+    int i = 0;
+    for (; i < an; ++i)
+    {
+        carry += (uint64_t)r[i] + a[i];
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    for (; carry && i < rn; ++i)
+    {
+        carry += r[i];
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    return (uint32_t)carry;
+}
+
+/* r -= a where an <= rn and r >= a */
+static void mag_sub_from(uint32_t *r, int rn, const uint32_t *a, int an)
+{
+    int64_t borrow = 0;
+    int i = 0;
+    for (; i < an; ++i)
+    {
+        int64_t t = (int64_t)r[i] - a[i] - borrow;
+        r[i] = (uint32_t)t;
+        borrow = t < 0;
+    }
+    for (; borrow && i < rn; ++i)
+    {
+        int64_t t = (int64_t)r[i] - borrow;
+        r[i] = (uint32_t)t;
+        borrow = t < 0;
+    }
+}
+
+/* r = a * b with r of an + bn limbs, one row of partial products at a time */
+static void mag_mul_school(uint32_t *r, const uint32_t *a, int an, const uint32_t *b, int bn)
+{
+    memset(r, 0, sizeof(uint32_t) * (an + bn));
+    for (int i = 0; i < an; ++i)
+    {
+        uint64_t carry = 0;
+        uint64_t x = a[i];
+        if (!x)
+            continue;
+        for (int j = 0; j < bn; ++j)
+        {
+            carry += x * b[j] + r[i + j];
+            r[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        r[i + bn] = (uint32_t)carry;
+    }
+}
+
+/*
+ * r = a * b with r of an + bn limbs. With a = a1 B + a0 and b = b1 B + b0
+ * the middle term a1 b0 + a0 b1 is (a0 + a1)(b0 + b1) - a0 b0 - a1 b1,
+ * three half-size products instead of four. Unbalanced operands are
+ * cut into pieces the size of the shorter one first.
+ */
+static void mag_mul(uint32_t *r, const uint32_t *a, int an, const uint32_t *b, int bn)
+{
+    if (an < bn)
+    {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        int tn = an;
+        an = bn;
+        bn = tn;
+    }
+
+    if (bn < LBIG_KARATSUBA_MIN)
+    {
+        mag_mul_school(r, a, an, b, bn);
+        return;
+    }
+
+    if (2 * bn <= an)
+    {
+        uint32_t *t = malloc(sizeof(uint32_t) * 2 * bn);
+        memset(r, 0, sizeof(uint32_t) * (an + bn));
+        for (int i = 0; i < an; i += bn)
+        {
+            int n = an - i < bn ? an - i : bn;
+            mag_mul(t, a + i, n, b, bn);
+            mag_add_to(r + i, an + bn - i, t, n + bn);
+        }
+        free(t);
+        return;
+    }
+
+    /* Split at m, the high half of b is not empty as bn > an / 2 */
+    int m = an / 2;
+    int hn = an - m > bn - m ? an - m : bn - m;
+    int sn = hn + 1;
+
+    uint32_t *sa = calloc(4 * sn, sizeof(uint32_t));
+    uint32_t *sb = sa + sn;
+    uint32_t *z1 = sb + sn;
+
+    /* Low and high products go straight to their place in r */
+    mag_mul(r, a, m, b, m);
+    mag_mul(r + 2 * m, a + m, an - m, b + m, bn - m);
+
+    memcpy(sa, a, sizeof(uint32_t) * m);
+    mag_add_to(sa, sn, a + m, an - m);
+    memcpy(sb, b, sizeof(uint32_t) * m);
+    mag_add_to(sb, sn, b + m, bn - m);
+
+    mag_mul(z1, sa, sn, sb, sn);
+    mag_sub_from(z1, 2 * sn, r, 2 * m);
+    mag_sub_from(z1, 2 * sn, r + 2 * m, an + bn - 2 * m);
+
+    /* The middle term fits in what is left of r above m */
+    int zn = 2 * sn;
+    while (zn && z1[zn - 1] == 0)
+        zn--;
+    mag_add_to(r + m, an + bn - m, z1, zn);
+
+    free(sa);
+}
+
+int lbig_cmp(lbig *a, lbig *b)
+{
+    if (a->neg != b->neg)
+        return a->neg ? -1 : 1;
+    int c = lbig_cmp_mag(a, b);
+    return a->neg ? -c : c;
+}
+
+/* Sum of a and b, with b's sign flipped if neg_b differs from b->neg */
+static lbig *lbig_add_signed(lbig *a, lbig *b, int neg_b)
+{
+    if (a->neg == neg_b)
+    {
+        lbig *x = a->len >= b->len ? a : b;
+        lbig *y = a->len >= b->len ? b : a;
+        lbig *r = lbig_alloc(x->len + 1);
+        memcpy(r->d, x->d, sizeof(uint32_t) * x->len);
+        r->d[x->len] = mag_add_to(r->d, x->len, y->d, y->len);
+        r->neg = a->neg;
+        return lbig_trim(r);
+    }
+
+    /* Signs differ, subtract the smaller magnitude from the larger */
+    int c = lbig_cmp_mag(a, b);
+    lbig *x = c >= 0 ? a : b;
+    lbig *y = c >= 0 ? b : a;
+    lbig *r = lbig_alloc(x->len);
+    memcpy(r->d, x->d, sizeof(uint32_t) * x->len);
+    mag_sub_from(r->d, r->len, y->d, y->len);
+    r->neg = c >= 0 ? a->neg : neg_b;
+    return lbig_trim(r);
+}
+
+lbig *lbig_add(lbig *a, lbig *b)
+{
+    return lbig_add_signed(a, b, b->neg);
+}
+
+lbig *lbig_sub(lbig *a, lbig *b)
+{
+    return lbig_add_signed(a, b, !b->neg);
+}
+
+lbig *lbig_mul(lbig *a, lbig *b)
+{
+    lbig *r = lbig_alloc(a->len + b->len);
+    if (a->len && b->len)
+        mag_mul(r->d, a->d, a->len, b->d, b->len);
+    r->neg = a->neg != b->neg;
+    return lbig_trim(r);
+}
+
+/* Schoolbook product, the baseline of the multiplication benchmark */
+lbig *lbig_mul_school(lbig *a, lbig *b)
+{
+    lbig *r = lbig_alloc(a->len + b->len);
+    if (a->len && b->len)
+        mag_mul_school(r->d, a->d, a->len, b->d, b->len);
+    r->neg = a->neg != b->neg;
+    return lbig_trim(r);
+}
+
+/* q = u / v in place, returns the remainder */
+static uint32_t mag_div_small(uint32_t *q, const uint32_t *u, int un, uint32_t v)
+{
+    uint64_t rem = 0;
+    for (int i = un - 1; i >= 0; --i)
+    {
+        uint64_t cur = (rem << 32) | u[i];
+        q[i] = (uint32_t)(cur / v);
+        rem = cur % v;
+    }
+    return (uint32_t)rem;
+}
+
+static int mag_clz(uint32_t x)
+{
+    int n = 0;
+    for (uint32_t bit = 0x80000000u; !(x & bit); bit >>= 1)
+        n++;
+    return n;
+}
+
+/*
+ * Long division of u by v with vn >= 2 and un >= vn (Knuth's algorithm D).
+ * q gets un - vn + 1 limbs and r gets vn limbs.
+ */
+static void mag_divmod(uint32_t *q, uint32_t *r, const uint32_t *u, int un, const uint32_t *v, int vn)
+{
+    /* Normalize so that the top limb of v has its high bit set */
+    int s = mag_clz(v[vn - 1]);
+    uint32_t *vs = malloc(sizeof(uint32_t) * (vn + un + 1));
+    uint32_t *us = vs + vn;
+
+    for (int i = vn - 1; i > 0; --i)
+        vs[i] = (v[i] << s) | (s ? v[i - 1] >> (32 - s) : 0);
+    vs[0] = v[0] << s;
+    us[un] = s ? u[un - 1] >> (32 - s) : 0;
+    for (int i = un - 1; i > 0; --i)
+        us[i] = (u[i] << s) | (s ? u[i - 1] >> (32 - s) : 0);
+    us[0] = u[0] << s;
+
+    for (int j = un - vn; j >= 0; --j)
+    {
+        /* Estimate the quotient limb from the top two limbs, off by at most one after this */
+        uint64_t num = ((uint64_t)us[j + vn] << 32) | us[j + vn - 1];
+        uint64_t qhat = num / vs[vn - 1];
+        uint64_t rhat = num % vs[vn - 1];
+        while (qhat >> 32 || qhat * vs[vn - 2] > ((rhat << 32) | us[j + vn - 2]))
+        {
+            qhat--;
+            rhat += vs[vn - 1];
+            if (rhat >> 32)
+                break;
+        }
+
+        /* Multiply and subtract */
+        int64_t borrow = 0;
+        uint64_t carry = 0;
+        for (int i = 0; i < vn; ++i)
+        {
+            uint64_t p = qhat * vs[i] + carry;
+            carry = p >> 32;
+            int64_t t = (int64_t)us[i + j] - (uint32_t)p - borrow;
+            us[i + j] = (uint32_t)t;
+            borrow = t < 0;
+        }
+        int64_t t = (int64_t)us[j + vn] - (int64_t)carry - borrow;
+        us[j + vn] = (uint32_t)t;
+
+        /* The estimate was one too large, add v back */
+        if (t < 0)
+        {
+            qhat--;
+            carry = 0;
+            for (int i = 0; i < vn; ++i)
+            {
+                carry += (uint64_t)us[i + j] + vs[i];
+                us[i + j] = (uint32_t)carry;
+                carry >>= 32;
+            }
+            us[j + vn] += (uint32_t)carry;
+        }
+        q[j] = (uint32_t)qhat;
+    }
+
+    for (int i = 0; i < vn; ++i)
+        r[i] = (us[i] >> s) | (s ? us[i + 1] << (32 - s) : 0);
+    free(vs);
+}
+
+/*
+ * Truncating division, the quotient rounds toward zero and the
+ * remainder has the sign of a. Returns -1 when b is zero.
+ */
+int lbig_divmod(lbig *a, lbig *b, lbig **q, lbig **r)
+{
+    if (!b->len)
+        return -1;
+
+    lbig *qq;
+    lbig *rr;
+    if (lbig_cmp_mag(a, b) < 0)
+    {
+        qq = lbig_alloc(0);
+        rr = lbig_copy(a);
+    }
+    else if (b->len == 1)
+    {
+        qq = lbig_alloc(a->len);
+        rr = lbig_alloc(1);
+        rr->d[0] = mag_div_small(qq->d, a->d, a->len, b->d[0]);
+    }
+    else
+    {
+        qq = lbig_alloc(a->len - b->len + 1);
+        rr = lbig_alloc(b->len);
+        mag_divmod(qq->d, rr->d, a->d, a->len, b->d, b->len);
+    }
+    qq->neg = a->neg != b->neg;
+    rr->neg = a->neg;
+    lbig_trim(qq);
+    lbig_trim(rr);
+
+    if (q)
+        *q = qq;
+    else
+        lbig_del(qq);
+    if (r)
+        *r = rr;
+    else
+        lbig_del(rr);
+    return 0;
+}
+
+/* a to the n by squaring, NULL if the result would be too large */
+lbig *lbig_pow(lbig *a, uint64_t n)
+{
+    int bits = a->len ? a->len * 32 - mag_clz(a->d[a->len - 1]) : 0;
+    if (bits > 1 && n > (uint64_t)LBIG_POW_MAX_BITS / (bits - 1))
+        return NULL;
+
+    lbig *r = lbig_from_int(1);
+    lbig *b = lbig_copy(a);
+    for (; n; n >>= 1)
+    {
+        if (n & 1)
+        {
+            lbig *t = lbig_mul(r, b);
+            lbig_del(r);
+            r = t;
+        }
+        if (n >> 1)
+        {
+            lbig *t = lbig_mul(b, b);
+            lbig_del(b);
+            b = t;
+        }
+    }
+    lbig_del(b);
+    return r;
+}
+
+/* Store a in x and return 1 if it fits in an int64 */
+int lbig_to_int(lbig *a, int64_t *x)
+{
+    if (a->len > 2)
+        return 0;
+
+    uint64_t m = 0;
+    for (int i = a->len - 1; i >= 0; --i)
+        m = (m << 32) | a->d[i];
+
+    if (a->neg ? m > (uint64_t)INT64_MAX + 1 : m > (uint64_t)INT64_MAX)
+        return 0;
+    *x = a->neg ? (int64_t)(0 - m) : (int64_t)m;
+    return 1;
+}
+
+double lbig_to_double(lbig *a)
+{
+    double d = 0;
+    for (int i = a->len - 1; i >= 0; --i)
+        d = d * 4294967296.0 + a->d[i];
+    return a->neg ? -d : d;
+}
+
+/* Parse an optionally signed run of decimal digits, nine at a time */
+lbig *lbig_from_str(const char *s)
+{
+    int neg = *s == '-';
+    if (*s == '-' || *s == '+')
+        s++;
+
+    int digits = (int)strlen(s);
+    lbig *a = lbig_alloc(digits / 9 + 2);
+    memset(a->d, 0, sizeof(uint32_t) * a->len);
+    int n = 0;
+
+    while (*s)
+    {
+        uint32_t chunk = 0;
+        uint32_t scale = 1;
+        for (int k = 0; k < 9 && *s; ++k, ++s)
+        {
+            chunk = chunk * 10 + (uint32_t)(*s - '0');
+            scale *= 10;
+        }
+
+        /* a = a * scale + chunk */
+        uint64_t carry = chunk;
+        for (int i = 0; i < n; ++i)
+        {
+            carry += (uint64_t)a->d[i] * scale;
+            a->d[i] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if (carry)
+            a->d[n++] = (uint32_t)carry;
+    }
+
+    a->len = n;
+    a->neg = neg;
+    return lbig_trim(a);
+}
+
+/* Decimal digits of a in a new string, nine at a time from the bottom */
+char *lbig_to_str(lbig *a)
+{
+    int n = a->len;
+    uint32_t *t = malloc(sizeof(uint32_t) * (n ? n : 1));
+    memcpy(t, a->d, sizeof(uint32_t) * n);
+
+    /* Each limb is fewer than 10 digits */
+    char *buf = malloc(n * 10 + 3);
+    char *p = buf + n * 10 + 2;
+    *p = '\0';
+
+    do
+    {
+        uint32_t chunk = mag_div_small(t, t, n, 1000000000u);
+        while (n && t[n - 1] == 0)
+            n--;
+        for (int k = 0; k < 9 && (n || chunk); ++k)
+        {
+            *--p = (char)('0' + chunk % 10);
+            chunk /= 10;
+        }
+    } while (n);
+
+    if (!*p)
+        *--p = '0';
+    if (a->neg)
+        *--p = '-';
+
+    char *s = malloc(strlen(p) + 1);
+    strcpy(s, p);
+    free(buf);
+    free(t);
+    return s;
+}
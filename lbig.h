@@ -0,0 +1,40 @@
+//=============================================================
+//             Arbitrary Precision Integers
+//=============================================================
+
+#include <stdint.h>
+
+/*
+ * Sign and magnitude in little-endian 32-bit limbs, without leading
+ * zero limbs so that zero has len 0. Values are immutable, every
+ * operation returns a new one that the caller frees with lbig_del.
+ */
+typedef struct lbig
+{
+    int neg;
+    int len;
+    uint32_t d[];
+} lbig;
+
+/* Operands of at least this many limbs are multiplied with Karatsuba */
+#define LBIG_KARATSUBA_MIN 32
+
+/* Powers whose result would have more bits than this are refused */
+#define LBIG_POW_MAX_BITS (1 << 24)
+
+lbig *lbig_from_int(int64_t x);
+lbig *lbig_from_str(const char *s);
+lbig *lbig_copy(lbig *a);
+void lbig_del(lbig *a);
+
+int lbig_to_int(lbig *a, int64_t *x);
+double lbig_to_double(lbig *a);
+char *lbig_to_str(lbig *a);
+
+int lbig_cmp(lbig *a, lbig *b);
+lbig *lbig_add(lbig *a, lbig *b);
+lbig *lbig_sub(lbig *a, lbig *b);
+lbig *lbig_mul(lbig *a, lbig *b);
+lbig *lbig_mul_school(lbig *a, lbig *b);
+int lbig_divmod(lbig *a, lbig *b, lbig **q, lbig **r);
+lbig *lbig_pow(lbig *a, uint64_t n);
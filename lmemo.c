@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpc.h"
+#include "lbig.h"
+#include "lvec.h"
+#include "parsing.h"
+
+//=======================================================
+//                Memoized Functions
+//=======================================================
+
+/*
+ * A memo wraps a function with a table from argument lists to results.
+ * Keys are matched structurally, with numbers only matching numbers of
+ * the same type so that (f 1) and (f 1.0) are cached apart. Entries are
+ * chained per bucket and kept on a list from most to least recently
+ * used, the least recently used one is evicted once capacity is reached.
+ *
+ * A heap memo keeps heap copies of its keys and results, so calls made
+ * while a form region is active promote what they store. A memo in a
+ * region only lives as long as its form, it keeps plain references.
+ */
+
+typedef struct lmemo_entry
+{
+    uint64_t hash;
+    lval *args;
+    lval *result;
+    struct lmemo_entry *chain;
+    struct lmemo_entry *newer;
+    struct lmemo_entry *older;
+} lmemo_entry;
+
+struct lmemo
+{
+    lval *fn;
+    int capacity;
+    int count;
+    int mask;
+    lmemo_entry **buckets;
+
+    /* Recency list */
+    lmemo_entry *newest;
+    lmemo_entry *oldest;
+
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+};
+
+/* Mix the bits of x into h */
+static uint64_t lmemo_mix(uint64_t h, uint64_t x)
+{
+    h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+static uint64_t lmemo_hash_bytes(uint64_t h, const void *p, size_t n)
+{
+    const unsigned char *s = p;
+    for (size_t i = 0; i < n; ++i)
+        h = (h ^ s[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+/* Structural hash of v, consistent with lmemo_same */
+static uint64_t lmemo_hash(lval *v)
+{
+    uint64_t h = lmemo_mix(0xcbf29ce484222325ULL, v->type);
+    switch (v->type)
+    {
+    case LVAL_NUM:
+        return lmemo_hash_bytes(h, &v->num, sizeof(double));
+    case LVAL_INT:
+        return lmemo_mix(h, (uint64_t)v->inum);
+    case LVAL_BIG:
+        return lmemo_hash_bytes(h, v->big->d, sizeof(uint32_t) * v->big->len) ^ v->big->neg;
+    case LVAL_VEC:
+        h = lmemo_mix(h, v->vec->elem);
+        return lmemo_hash_bytes(h, v->vec->f64, sizeof(double) * v->vec->count);
+    case LVAL_ERR:
+        return lmemo_hash_bytes(h, v->err, strlen(v->err));
+    case LVAL_SYM:
+        return lmemo_mix(h, (uint64_t)(uintptr_t)v->sym);
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+        for (int i = 0; i < v->count; ++i)
+            h = lmemo_mix(h, lmemo_hash(v->cell[i]));
+        return h;
+    default:
+        /* Functions only match themselves */
+        return lmemo_mix(h, (uint64_t)(uintptr_t)v);
+    }
+}
+
+/* Whether x and y are the same value, types included */
+static int lmemo_same(lval *x, lval *y)
+{
+    if (x == y)
+        return 1;
+    if (x->type != y->type)
+        return 0;
+
+    switch (x->type)
+    {
+    case LVAL_NUM:
+        return memcmp(&x->num, &y->num, sizeof(double)) == 0;
+    case LVAL_VEC:
+        return x->vec->elem == y->vec->elem && x->vec->count == y->vec->count &&
+               memcmp(x->vec->f64, y->vec->f64, sizeof(double) * x->vec->count) == 0;
+    case LVAL_INT:
+    case LVAL_BIG:
+    case LVAL_ERR:
+    case LVAL_SYM:
+        return lval_eq(x, y);
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+        if (x->count != y->count)
+            return 0;
+        for (int i = 0; i < x->count; ++i)
+            if (!lmemo_same(x->cell[i], y->cell[i]))
+                return 0;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* New empty memo of fn, which it takes, holding up to capacity results, at least one */
+lmemo *lmemo_new(lval *fn, int capacity)
+{
+    lmemo *m = calloc(1, sizeof(lmemo));
+    m->fn = fn;
+    m->capacity = capacity;
+
+    /* Buckets for twice the capacity, capped for huge ones that may never fill */
+    int n = 8;
+    while (n < capacity * 2 && n < (1 << 20))
+        n *= 2;
+    m->mask = n - 1;
+    m->buckets = calloc(n, sizeof(lmemo_entry *));
+    return m;
+}
+
+/* Unlink e from the recency list */
+static void lmemo_unlink(lmemo *m, lmemo_entry *e)
+{
+    if (e->newer)
+        e->newer->older = e->older;
+    else
+        m->newest = e->older;
+    if (e->older)
+        e->older->newer = e->newer;
+    else
+        m->oldest = e->newer;
+}
+
+/* Make e the most recently used entry */
+static void lmemo_touch(lmemo *m, lmemo_entry *e)
+{
+    e->newer = NULL;
+    e->older = m->newest;
+    if (m->newest)
+        m->newest->newer = e;
+    m->newest = e;
+    if (!m->oldest)
+        m->oldest = e;
+}
+
+/* Add a new most recently used entry, the table takes args and result */
+static void lmemo_insert(lmemo *m, uint64_t hash, lval *args, lval *result)
+{
+    lmemo_entry *e = malloc(sizeof(lmemo_entry));
+    e->hash = hash;
+    e->args = args;
+    e->result = result;
+    e->chain = m->buckets[hash & m->mask];
+    m->buckets[hash & m->mask] = e;
+    lmemo_touch(m, e);
+    m->count++;
+}
+
+/* Evict the least recently used entry */
+static void lmemo_evict(lmemo *m)
+{
+    lmemo_entry *e = m->oldest;
+    lmemo_entry **p = &m->buckets[e->hash & m->mask];
+    while (*p != e)
+        p = &(*p)->chain;
+    *p = e->chain;
+    lmemo_unlink(m, e);
+
+    lval_release(e->args);
+    lval_release(e->result);
+    free(e);
+    m->count--;
+    m->evictions++;
+}
+
+/* Copy of memo m, with keep applied to its function and entries */
+lmemo *lmemo_copy(lmemo *m, lval *(*keep)(lval *))
+{
+    lmemo *x = lmemo_new(keep(m->fn), m->capacity);
+
+    /* Oldest first, so that the copy has the same order of recency */
+    for (lmemo_entry *e = m->oldest; e; e = e->newer)
+        lmemo_insert(x, e->hash, keep(e->args), keep(e->result));
+
+    x->hits = m->hits;
+    x->misses = m->misses;
+    x->evictions = m->evictions;
+    return x;
+}
+
+/* Free memo m, dropping its references unless they went with a region */
+void lmemo_del(lmemo *m, int drop)
+{
+    if (!m)
+        return;
+
+    lmemo_entry *e = m->newest;
+    while (e)
+    {
+        lmemo_entry *next = e->older;
+        if (drop)
+        {
+            lval_del(e->args);
+            lval_del(e->result);
+        }
+        free(e);
+        e = next;
+    }
+    if (drop)
+        lval_del(m->fn);
+    free(m->buckets);
+    free(m);
+}
+
+lval *lmemo_fn(lmemo *m)
+{
+    return m->fn;
+}
+
+void lmemo_stats(lmemo *m, size_t *hits, size_t *misses, int *count, int *capacity)
+{
+    *hits = m->hits;
+    *misses = m->misses;
+    *count = m->count;
+    *capacity = m->capacity;
+}
+
+/* Reference to x that memo v can keep */
+static lval *lmemo_keep(lval *v, lval *x)
+{
+    return v->flags & LVAL_REGION ? lval_copy(x) : lval_promote(x);
+}
+
+/* Call memo v with arguments a, from the table when it has them */
+lval *lmemo_call(lenv *e, lval *v, lval *a)
+{
+    lmemo *m = v->memo;
+    uint64_t hash = lmemo_hash(a);
+
+    for (lmemo_entry *x = m->buckets[hash & m->mask]; x; x = x->chain)
+    {
+        if (x->hash == hash && lmemo_same(x->args, a))
+        {
+            m->hits++;
+            lmemo_unlink(m, x);
+            lmemo_touch(m, x);
+            lval_del(a);
+            return lval_copy(x->result);
+        }
+    }
+    m->misses++;
+
+    /* The call consumes the arguments, the key is a list of the table's own */
+    lval *key = (a->flags & LVAL_REGION) && !(v->flags & LVAL_REGION) ? lval_promote(a) : lval_dup(a);
+    lgc_pin();
+    lval *r = lval_call(e, m->fn, a);
+    lgc_unpin();
+
+    /* Errors are not cached */
+    if (r->type == LVAL_ERR)
+    {
+        lval_release(key);
+        return r;
+    }
+
+    if (m->count == m->capacity)
+        lmemo_evict(m);
+    lmemo_insert(m, hash, key, lmemo_keep(v, r));
+    return r;
+}
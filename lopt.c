@@ -0,0 +1,587 @@
+#include <stdlib.h>
+#include "mpc.h"
+#include "lbig.h"
+#include "lvec.h"
+#include "parsing.h"
+
+//=======================================================
+//                Optimizing Pass
+//=======================================================
+
+/*
+ * An optional rewrite run over each form after it is read and over each
+ * lambda body before it runs. Applications of arithmetic and comparison
+ * builtins to number literals are replaced by their value, and calls to
+ * small global lambdas are replaced by their body with the arguments put
+ * in place of the formals.
+ *
+ * Both depend on what global names are bound to when the pass runs. The
+ * names it relies on are recorded, and lopt_version is bumped once one
+ * of them is rebound or shadowed by a frame. The optimized body of a
+ * lambda, the version it was made at and the code compiled from it are
+ * kept in a table keyed by the lambda, which is shared and so is never
+ * changed. The pass is redone when the version is stale, frames still
+ * running the old code hold their own reference to it.
+ *
+ * Code that may bind names as it runs, with def or '=', is left alone.
+ * Inlined bodies may only refer to their formals and to globals that the
+ * call site sees as well. Arguments must be literals or bound symbols,
+ * which evaluate the same wherever the body uses them, constant ones are
+ * folded before the call is looked at.
+ */
+
+int lopt_enabled = 0;
+unsigned lopt_version = 1;
+
+/* Largest lambda body, in symbols and literals, that is inlined */
+#define LOPT_INLINE_SIZE 16
+
+/* Inlined bodies inlined into each other, which bounds mutual recursion */
+#define LOPT_INLINE_DEPTH 3
+
+/* Names the pass relied on, an open-addressing set of interned symbols */
+static struct
+{
+    char **syms;
+    int count;
+    int cap;
+} lopt_used;
+
+static unsigned lopt_hash(char *sym)
+{
+    return (unsigned)((uintptr_t)sym >> 3) * 2654435761u;
+}
+
+/* Slot of sym in the set, or of the free slot it would take */
+static int lopt_slot(char *sym)
+{
+    int i = lopt_hash(sym) & (lopt_used.cap - 1);
+    while (lopt_used.syms[i] && lopt_used.syms[i] != sym)
+        i = (i + 1) & (lopt_used.cap - 1);
+    return i;
+}
+
+/* Record that the pass relied on what sym is bound to */
+static void lopt_use(char *sym)
+{
+    if (lopt_used.count * 2 >= lopt_used.cap)
+    {
+        char **old = lopt_used.syms;
+        int n = lopt_used.cap;
+        lopt_used.cap = n ? n * 2 : 64;
+        lopt_used.syms = calloc(lopt_used.cap, sizeof(char *));
+        for (int i = 0; i < n; ++i)
+            if (old[i])
+                lopt_used.syms[lopt_slot(old[i])] = old[i];
+        free(old);
+    }
+
+    int i = lopt_slot(sym);
+    if (!lopt_used.syms[i])
+    {
+        lopt_used.syms[i] = sym;
+        lopt_used.count++;
+    }
+}
+
+/* Optimized body of a heap lambda and the code compiled from it */
+typedef struct lopt_entry
+{
+    lval *fn; /* borrowed, the entry is dropped with it */
+    lval *opt;
+    unsigned version;
+    lcode *code;
+} lopt_entry;
+
+/* Entries by lambda, open addressing with linear probing */
+static struct
+{
+    lopt_entry *items;
+    int count;
+    int cap;
+} lopt_bodies;
+
+/* Slot of f in the table, or of the free slot it would take */
+static int lopt_body_slot(lval *f)
+{
+    int i = lopt_hash((char *)f) & (lopt_bodies.cap - 1);
+    while (lopt_bodies.items[i].fn && lopt_bodies.items[i].fn != f)
+        i = (i + 1) & (lopt_bodies.cap - 1);
+    return i;
+}
+
+/* Entry of lambda f, added empty if it has none */
+static lopt_entry *lopt_entry_of(lval *f)
+{
+    if (lopt_bodies.count * 2 >= lopt_bodies.cap)
+    {
+        lopt_entry *old = lopt_bodies.items;
+        int n = lopt_bodies.cap;
+        lopt_bodies.cap = n ? n * 2 : 64;
+        lopt_bodies.items = calloc(lopt_bodies.cap, sizeof(lopt_entry));
+        for (int i = 0; i < n; ++i)
+            if (old[i].fn)
+                lopt_bodies.items[lopt_body_slot(old[i].fn)] = old[i];
+        free(old);
+    }
+
+    lopt_entry *x = &lopt_bodies.items[lopt_body_slot(f)];
+    if (!x->fn)
+    {
+        *x = (lopt_entry){f, NULL, 0, NULL};
+        lopt_bodies.count++;
+    }
+    return x;
+}
+
+/* Drop the entry of lambda f as it is deleted */
+void lopt_forget(lval *f)
+{
+    if (!lopt_bodies.count)
+        return;
+
+    int mask = lopt_bodies.cap - 1;
+    int i = lopt_body_slot(f);
+    if (!lopt_bodies.items[i].fn)
+        return;
+
+    lval *opt = lopt_bodies.items[i].opt;
+    lcode *code = lopt_bodies.items[i].code;
+
+    /* Move later entries of the probe run back over the gap */
+    for (int j = (i + 1) & mask; lopt_bodies.items[j].fn; j = (j + 1) & mask)
+    {
+        int k = lopt_hash((char *)lopt_bodies.items[j].fn) & mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        lopt_bodies.items[i] = lopt_bodies.items[j];
+        i = j;
+    }
+    lopt_bodies.items[i].fn = NULL;
+    lopt_bodies.count--;
+
+    /* Released once the table is consistent, as they may delete lambdas */
+    if (opt)
+        lval_release(opt);
+    lcode_del(code);
+}
+
+/* Called when sym is rebound globally or gains a binding in a frame */
+void lopt_rebind(char *sym)
+{
+    if (lopt_used.count && lopt_used.syms[lopt_slot(sym)])
+        lopt_version++;
+}
+
+/* Code being optimized and the bindings it runs with */
+typedef struct lopt
+{
+    lenv *env;     /* env the code runs in, or the env a lambda closes over */
+    lval *formals; /* formals of the lambda, bound in a frame below env, or NULL */
+    int depth;     /* inlined bodies being optimized */
+} lopt;
+
+static int lopt_is_formal(lval *formals, char *sym)
+{
+    if (!formals)
+        return 0;
+    for (int i = 0; i < formals->count; ++i)
+        if (formals->cell[i]->sym == sym)
+            return 1;
+    return 0;
+}
+
+/* Value sym is bound to in the root env, NULL if unbound there or bound below it */
+static lval *lopt_global(lopt *o, char *sym)
+{
+    if (lopt_is_formal(o->formals, sym))
+        return NULL;
+
+    for (lenv *e = o->env; e; e = e->par)
+    {
+        int i = lenv_find(e, sym);
+        if (i != -1)
+            return e->par ? NULL : e->vals[i];
+    }
+    return NULL;
+}
+
+/* Whether looking up sym will find a binding */
+static int lopt_bound(lopt *o, char *sym)
+{
+    if (lopt_is_formal(o->formals, sym))
+        return 1;
+    for (lenv *e = o->env; e; e = e->par)
+        if (lenv_find(e, sym) != -1)
+            return 1;
+    return 0;
+}
+
+/* Builtin that symbol v is globally bound to, or NULL */
+static lbuiltin lopt_builtin(lopt *o, lval *v)
+{
+    if (v->type != LVAL_SYM)
+        return NULL;
+    lval *x = lopt_global(o, v->sym);
+    return x && x->type == LVAL_FUNC ? x->builtin : NULL;
+}
+
+/* Builtins whose result only depends on their number arguments */
+static int lopt_pure(lbuiltin b)
+{
+    return b == builtin_add || b == builtin_sub || b == builtin_mul ||
+           b == builtin_div || b == builtin_mod || b == builtin_pow ||
+           b == builtin_gt || b == builtin_lt || b == builtin_ge || b == builtin_le ||
+           b == builtin_eq || b == builtin_ne;
+}
+
+/*
+ * Builtins an inlined body may use, whose result does not depend on the
+ * env they are called in. 'if' is handled apart, its branches are code.
+ */
+static int lopt_closed_builtin(lbuiltin b)
+{
+    return lopt_pure(b) ||
+           b == builtin_head || b == builtin_tail || b == builtin_list || b == builtin_join ||
+           b == builtin_cons || b == builtin_len || b == builtin_init || b == builtin_nth ||
+           b == builtin_slice;
+}
+
+/* Whether v is '(if c {A} {B})' with 'if' bound to the builtin, so its branches are code */
+static int lopt_is_if(lopt *o, lval *v)
+{
+    return v->count == 4 && lopt_builtin(o, v->cell[0]) == builtin_if;
+}
+
+/* Whether code v refers to a builtin that binds names, anywhere in it */
+static int lopt_binds(lopt *o, lval *v)
+{
+    if (v->type == LVAL_SYM)
+    {
+        lbuiltin b = lopt_builtin(o, v);
+        return b == builtin_def || b == builtin_put;
+    }
+    if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR)
+        for (int i = 0; i < v->count; ++i)
+            if (lopt_binds(o, v->cell[i]))
+                return 1;
+    return 0;
+}
+
+/* Number of symbols and literals in v */
+static int lopt_size(lval *v)
+{
+    if (v->type != LVAL_SEXPR && v->type != LVAL_QEXPR)
+        return 1;
+    int n = 0;
+    for (int i = 0; i < v->count; ++i)
+        n += lopt_size(v->cell[i]);
+    return n;
+}
+
+/*
+ * Whether sym occurs in code v where its value may be kept or printed,
+ * rather than only called or passed to a pure builtin. Builtins print
+ * by the name they were looked up with, so such uses keep their name.
+ */
+static int lopt_escapes(lopt *o, lval *v, char *sym)
+{
+    if (v->type == LVAL_SYM)
+        return v->sym == sym;
+    if (v->type != LVAL_SEXPR && v->type != LVAL_QEXPR)
+        return 0;
+
+    int pure = v->count >= 2 && lopt_pure(lopt_builtin(o, v->cell[0]));
+    for (int i = 0; i < v->count; ++i)
+    {
+        lval *x = v->cell[i];
+        if (x->type == LVAL_SYM && x->sym == sym && ((i == 0 && v->count >= 2) || (i > 0 && pure)))
+            continue;
+        if (lopt_escapes(o, x, sym))
+            return 1;
+    }
+    return 0;
+}
+
+/* Value of v when it applies a pure builtin to numbers, or NULL */
+static lval *lopt_fold(lopt *o, lval *v)
+{
+    if (v->count < 2 || !lopt_pure(lopt_builtin(o, v->cell[0])))
+        return NULL;
+    for (int i = 1; i < v->count; ++i)
+        if (!LVAL_IS_NUM(v->cell[i]))
+            return NULL;
+
+    lval *a = lval_reserve(lval_sexpr(), v->count - 1);
+    for (int i = 1; i < v->count; ++i)
+        a = lval_add_tail(a, lval_copy(v->cell[i]));
+    lval *r = lopt_builtin(o, v->cell[0])(o->env, a);
+
+    /* Errors are left to be raised when the code runs */
+    if (r->type == LVAL_ERR)
+    {
+        lval_del(r);
+        return NULL;
+    }
+    lopt_use(v->cell[0]->sym);
+    return r;
+}
+
+/* Whether a call to global value x runs the same wherever it is made */
+static int lopt_closed_fn(lval *x)
+{
+    if (x->type == LVAL_FUNC)
+        return !x->builtin || lopt_closed_builtin(x->builtin);
+    return x->type == LVAL_PART || x->type == LVAL_MEMO;
+}
+
+/* Whether sym is called somewhere in code v */
+static int lopt_calls(lval *v, char *sym)
+{
+    if (v->type != LVAL_SEXPR && v->type != LVAL_QEXPR)
+        return 0;
+    if (v->count >= 2 && v->cell[0]->type == LVAL_SYM && v->cell[0]->sym == sym)
+        return 1;
+    for (int i = 0; i < v->count; ++i)
+        if (lopt_calls(v->cell[i], sym))
+            return 1;
+    return 0;
+}
+
+/*
+ * Whether the code in list v, from the body of lambda f named name,
+ * only refers to f's formals and to globals the call site sees too.
+ * Q-Expressions are only allowed as branches of 'if'. Builtins that
+ * bind names or evaluate code, such as def, '=', eval and '\', run in
+ * the lambda's frame and would see the caller's env once inlined.
+ */
+static int lopt_closed(lopt *o, lval *f, lval *v, char *name)
+{
+    int branches = lopt_is_if(o, v) && v->cell[2]->type == LVAL_QEXPR && v->cell[3]->type == LVAL_QEXPR;
+    for (int i = 0; i < v->count; ++i)
+    {
+        lval *x = v->cell[i];
+        if (x->type == LVAL_SYM)
+        {
+            if (lopt_is_formal(f->formals, x->sym))
+                continue;
+            lval *g = lopt_global(o, x->sym);
+            if (x->sym == name || !g)
+                return 0;
+            if (g->type == LVAL_FUNC && g->builtin && !lopt_closed_builtin(g->builtin) &&
+                !(g->builtin == builtin_if && i == 0 && branches))
+                return 0;
+            lopt_use(x->sym);
+        }
+        else if (x->type == LVAL_SEXPR || (x->type == LVAL_QEXPR && branches && i >= 2))
+        {
+            if (!lopt_closed(o, f, x, name))
+                return 0;
+        }
+        else if (x->type == LVAL_QEXPR)
+            return 0;
+    }
+    return 1;
+}
+
+/* Copy of list v as type, with formals replaced by args */
+static lval *lopt_subst(lval *v, int type, lval *formals, lval **args)
+{
+    lval *x = lval_reserve(type == LVAL_SEXPR ? lval_sexpr() : lval_qexpr(), v->count);
+    for (int i = 0; i < v->count; ++i)
+    {
+        lval *c = v->cell[i];
+        if (c->type == LVAL_SEXPR || c->type == LVAL_QEXPR)
+        {
+            x = lval_add_tail(x, lopt_subst(c, c->type, formals, args));
+            continue;
+        }
+
+        int k = 0;
+        while (c->type == LVAL_SYM && k < formals->count && formals->cell[k]->sym != c->sym)
+            k++;
+        x = lval_add_tail(x, lval_copy(c->type == LVAL_SYM && k < formals->count ? args[k] : c));
+    }
+    return x;
+}
+
+static lval *lopt_expr(lopt *o, lval *v);
+
+/* Body of the small global lambda called by v, with the arguments in place, or NULL */
+static lval *lopt_inline(lopt *o, lval *v)
+{
+    /* A single expression is its value rather than a call */
+    if (v->count < 2 || v->cell[0]->type != LVAL_SYM)
+        return NULL;
+    char *name = v->cell[0]->sym;
+    lval *f = lopt_global(o, name);
+    if (!f || f->type != LVAL_FUNC || f->builtin || f->env->par)
+        return NULL;
+
+    /* Exactly as many arguments as distinct formals, and no '&' */
+    lval *formals = f->formals;
+    if (formals->count != v->count - 1 || lopt_size(f->body) > LOPT_INLINE_SIZE)
+        return NULL;
+    for (int i = 0; i < formals->count; ++i)
+    {
+        if (formals->cell[i]->sym == lsym_amp)
+            return NULL;
+        for (int j = 0; j < i; ++j)
+            if (formals->cell[j]->sym == formals->cell[i]->sym)
+                return NULL;
+
+        lval *a = v->cell[i + 1];
+        if (a->type != LVAL_SYM)
+        {
+            if (!LVAL_IS_NUM(a) && a->type != LVAL_QEXPR)
+                return NULL;
+            continue;
+        }
+        if (!lopt_bound(o, a->sym))
+            return NULL;
+
+        /* What a formal is called as must not depend on where it runs */
+        if (lopt_calls(f->body, formals->cell[i]->sym))
+        {
+            lval *g = lopt_global(o, a->sym);
+            if (!g || !lopt_closed_fn(g))
+                return NULL;
+            lopt_use(a->sym);
+        }
+
+        /* A global that is not a builtin has no name to lose */
+        if (lopt_escapes(o, f->body, formals->cell[i]->sym))
+        {
+            lval *g = lopt_global(o, a->sym);
+            if (!g || (g->type == LVAL_FUNC && g->builtin))
+                return NULL;
+            lopt_use(a->sym);
+        }
+    }
+    if (!lopt_closed(o, f, f->body, name))
+        return NULL;
+    lopt_use(name);
+
+    /* The body runs as an S-Expression */
+    lval *x = lopt_subst(f->body, LVAL_SEXPR, formals, v->cell + 1);
+    o->depth++;
+    lval *r = lopt_expr(o, x);
+    o->depth--;
+    lval_del(x);
+
+    /* A single expression evaluates to itself */
+    if (r->type == LVAL_SEXPR && r->count == 1)
+        r = lval_take(r, 0);
+    return r;
+}
+
+/* Copy of code list v, of the same type, with its elements optimized */
+static lval *lopt_code(lopt *o, lval *v)
+{
+    int branches = lopt_is_if(o, v);
+    if (branches)
+        lopt_use(v->cell[0]->sym);
+
+    lval *x = lval_reserve(v->type == LVAL_SEXPR ? lval_sexpr() : lval_qexpr(), v->count);
+    for (int i = 0; i < v->count; ++i)
+    {
+        lval *c = v->cell[i];
+        if (c->type == LVAL_QEXPR && branches && i >= 2)
+            x = lval_add_tail(x, lopt_code(o, c));
+        else
+            x = lval_add_tail(x, lopt_expr(o, c));
+    }
+
+    /* A branch runs as an S-Expression, so it may be folded as one */
+    if (x->type == LVAL_QEXPR)
+    {
+        lval *r = lopt_fold(o, x);
+        if (!r && o->depth < LOPT_INLINE_DEPTH)
+            r = lopt_inline(o, x);
+        if (r)
+        {
+            lval_del(x);
+            if (r->type == LVAL_SEXPR)
+            {
+                x = lval_mut(r);
+                x->type = LVAL_QEXPR;
+            }
+            else
+                x = lval_add_tail(lval_qexpr(), r);
+        }
+    }
+    return x;
+}
+
+/* Optimized copy of expression v */
+static lval *lopt_expr(lopt *o, lval *v)
+{
+    if (v->type != LVAL_SEXPR)
+        return lval_copy(v);
+
+    lval *x = lopt_code(o, v);
+    lval *r = lopt_fold(o, x);
+    if (!r && o->depth < LOPT_INLINE_DEPTH)
+        r = lopt_inline(o, x);
+    if (!r)
+        return x;
+    lval_del(x);
+    return r;
+}
+
+/* Optimized form v, read to be evaluated in e, taking v */
+lval *lopt_form(lenv *e, lval *v)
+{
+    lopt o = {e, NULL, 0};
+    if (lopt_binds(&o, v))
+        return v;
+
+    lval *x = lopt_expr(&o, v);
+    lval_del(v);
+    return x;
+}
+
+/*
+ * Body to run for lambda f, its optimized copy once the pass is enabled.
+ * Region lambdas go with their form and are optimized on each call.
+ */
+lval *lopt_body(lval *f)
+{
+    if (!lopt_enabled)
+        return f->body;
+
+    if (!(f->flags & LVAL_REGION))
+    {
+        lopt_entry *x = lopt_entry_of(f);
+        if (x->opt && x->version == lopt_version)
+            return x->opt;
+    }
+
+    lopt o = {f->env, f->formals, 0};
+    lval *x = lopt_binds(&o, f->body) ? lval_copy(f->body) : lopt_code(&o, f->body);
+    if (f->flags & LVAL_REGION)
+        return x;
+
+    lval *h = lval_promote(x);
+    lval_del(x);
+
+    /* The pass may have grown the table, and code compiled from the previous body is stale */
+    lopt_entry *e = lopt_entry_of(f);
+    lval *old = e->opt;
+    lcode *code = e->code;
+    e->opt = h;
+    e->version = lopt_version;
+    e->code = NULL;
+    if (old)
+        lval_release(old);
+    lcode_del(code);
+    return h;
+}
+
+/* Slot for code compiled from the optimized body of heap lambda f, NULL for region ones */
+lcode **lopt_code_slot(lval *f)
+{
+    if (f->flags & LVAL_REGION)
+        return NULL;
+    return &lopt_entry_of(f)->code;
+}
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpc.h"
+#include "lbig.h"
+#include "lvec.h"
+#include "parsing.h"
+
+//=======================================================
+//                Hand-written Reader
+//=======================================================
+
+/*
+ * A single pass reader of the grammar lispy_parser builds with mpc.
+ * Characters are classified by a table, tokens are matched the way the
+ * grammar's rules match them, numbers before symbols, and lists are read
+ * by recursive descent straight into lvals.
+ *
+ * mpc reports the furthest position a rule failed at along with what
+ * each rule failing there expected. The reader only fails where the next
+ * expression cannot start, so those are the starts of an expression and
+ * the end of the enclosing list, plus the continuations of the token
+ * just before when nothing separates it from the failure.
+ */
+
+/* Character classes */
+#define LREAD_SPACE 1
+#define LREAD_DIGIT 2
+#define LREAD_SYMBOL 4 /* of the symbol regex, digits included */
+
+static unsigned char lread_class[256];
+
+/* What ended just before the reader's position, for error messages */
+typedef enum LREAD_LAST
+{
+    LREAD_NONE = 0,
+    LREAD_INT,   /* digits, which may go on with digits or a fraction */
+    LREAD_FRAC,  /* a fraction, which may go on with digits */
+    LREAD_SYM,   /* a symbol, which may go on with symbol characters */
+    LREAD_MINUS, /* the symbol '-', which failed as a number */
+} LREAD_LAST;
+
+/* Names of what mpc expected, as its parsers give them */
+static char *LREAD_DIGIT1 = "one of '0123456789'";
+static char *LREAD_DOT1 = "one of '.'";
+static char *LREAD_DIGITS = "one or more of one of '0123456789'";
+static char *LREAD_SYM1 = "one of 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_+-*/\\=<>!&'";
+static char *LREAD_SYMS = "one or more of one of 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_+-*/\\=<>!&'";
+
+typedef struct lreader
+{
+    const char *filename;
+    const char *src;
+    const char *p;
+    const char *end;
+    long row;
+    long col;
+
+    /* End and kind of the last token */
+    const char *last;
+    LREAD_LAST last_kind;
+
+    char *err;
+} lreader;
+
+static void lread_init(void)
+{
+    if (lread_class[' '])
+        return;
+
+    for (const char *c = " \f\n\r\t\v"; *c; ++c)
+        lread_class[(unsigned char)*c] = LREAD_SPACE;
+    for (const char *c = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_+-*/\\=<>!&"; *c; ++c)
+        lread_class[(unsigned char)*c] = LREAD_SYMBOL;
+    for (int c = '0'; c <= '9'; ++c)
+        lread_class[c] = LREAD_DIGIT | LREAD_SYMBOL;
+}
+
+static int lread_is(lreader *r, const char *p, int class)
+{
+    return p < r->end && (lread_class[(unsigned char)*p] & class);
+}
+
+/* Move past n characters of a token, which never holds a newline */
+static void lread_skip(lreader *r, int n)
+{
+    r->p += n;
+    r->col += n;
+}
+
+/* Tokens are followed by any amount of whitespace */
+static void lread_space(lreader *r)
+{
+    while (lread_is(r, r->p, LREAD_SPACE))
+    {
+        if (*r->p++ == '\n')
+        {
+            r->row++;
+            r->col = 0;
+        }
+        else
+            r->col++;
+    }
+}
+
+/* Add x to the n names in xs unless it is already there */
+static void lread_expect(char **xs, int *n, char *x)
+{
+    for (int i = 0; i < *n; ++i)
+        if (xs[i] == x)
+            return;
+    xs[(*n)++] = x;
+}
+
+/* Set the error of failing at the reader's position, inside a list ended by close or at the top */
+static void lread_fail(lreader *r, char close)
+{
+    char *xs[16];
+    int n = 0;
+
+    if (r->last == r->p)
+    {
+        switch (r->last_kind)
+        {
+        case LREAD_INT:
+            lread_expect(xs, &n, LREAD_DIGIT1);
+            lread_expect(xs, &n, LREAD_DOT1);
+            break;
+        case LREAD_FRAC:
+            lread_expect(xs, &n, LREAD_DIGIT1);
+            break;
+        case LREAD_SYM:
+            lread_expect(xs, &n, LREAD_SYM1);
+            break;
+        case LREAD_MINUS:
+            lread_expect(xs, &n, LREAD_DIGITS);
+            lread_expect(xs, &n, LREAD_SYM1);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* Starts of an expression */
+    lread_expect(xs, &n, "'-'");
+    lread_expect(xs, &n, LREAD_DIGITS);
+    lread_expect(xs, &n, LREAD_SYMS);
+    lread_expect(xs, &n, "'%'");
+    lread_expect(xs, &n, "'^'");
+    lread_expect(xs, &n, "'('");
+    lread_expect(xs, &n, "'{'");
+
+    if (close)
+        lread_expect(xs, &n, close == ')' ? "')'" : "'}'");
+    else
+    {
+        lread_expect(xs, &n, "newline");
+        lread_expect(xs, &n, "end of input");
+    }
+
+    /* Formatted by mpc, so that both readers print errors alike */
+    mpc_err_t e;
+    e.state.pos = r->p - r->src;
+    e.state.row = r->row;
+    e.state.col = r->col;
+    e.state.term = 0;
+    e.expected_num = n;
+    e.filename = (char *)r->filename;
+    e.failure = NULL;
+    e.expected = xs;
+    e.received = r->p < r->end ? *r->p : '\0';
+    r->err = mpc_err_string(&e);
+}
+
+/* Value of the token from the reader's position to q, read by f */
+static lval *lread_token(lreader *r, const char *q, LREAD_LAST kind, lval *(*f)(char *))
+{
+    int n = q - r->p;
+    char buf[64];
+    char *s = n < (int)sizeof(buf) ? buf : malloc(n + 1);
+    memcpy(s, r->p, n);
+    s[n] = '\0';
+
+    lval *v = f(s);
+    if (s != buf)
+        free(s);
+
+    lread_skip(r, n);
+    r->last = r->p;
+    r->last_kind = kind;
+    return v;
+}
+
+/* Number or symbol at the reader's position, NULL if none starts there */
+static lval *lread_atom(lreader *r)
+{
+    const char *s = r->p;
+    const char *q = s;
+
+    /* A number is tried first, so '-5' is one but '-' and '-x' are symbols */
+    if (q < r->end && *q == '-')
+        q++;
+    if (lread_is(r, q, LREAD_DIGIT))
+    {
+        while (lread_is(r, q, LREAD_DIGIT))
+            q++;
+        if (q < r->end && *q == '.')
+        {
+            q++;
+            while (lread_is(r, q, LREAD_DIGIT))
+                q++;
+            return lread_token(r, q, LREAD_FRAC, lval_read_num);
+        }
+        return lread_token(r, q, LREAD_INT, lval_read_num);
+    }
+
+    if (lread_is(r, s, LREAD_SYMBOL))
+    {
+        q = s;
+        while (lread_is(r, q, LREAD_SYMBOL))
+            q++;
+        return lread_token(r, q, q - s == 1 && *s == '-' ? LREAD_MINUS : LREAD_SYM, lval_sym);
+    }
+
+    if (s < r->end && (*s == '%' || *s == '^'))
+        return lread_token(r, s + 1, LREAD_NONE, lval_sym);
+
+    return NULL;
+}
+
+static lval *lread_list(lreader *r, lval *x, char close);
+
+/* Expression at the reader's position, NULL if none starts there or it fails */
+static lval *lread_expr(lreader *r)
+{
+    if (r->p < r->end && (*r->p == '(' || *r->p == '{'))
+    {
+        char open = *r->p;
+        lread_skip(r, 1);
+        r->last_kind = LREAD_NONE;
+        lread_space(r);
+        return open == '(' ? lread_list(r, lval_sexpr(), ')') : lread_list(r, lval_qexpr(), '}');
+    }
+
+    lval *v = lread_atom(r);
+    if (v)
+        lread_space(r);
+    return v;
+}
+
+/* Read expressions into list x until close, or the end of input if close is 0 */
+static lval *lread_list(lreader *r, lval *x, char close)
+{
+    for (;;)
+    {
+        if (close ? r->p < r->end && *r->p == close : r->p == r->end)
+        {
+            if (close)
+            {
+                lread_skip(r, 1);
+                r->last_kind = LREAD_NONE;
+                lread_space(r);
+            }
+            return x;
+        }
+
+        lval *v = lread_expr(r);
+        if (!v)
+        {
+            if (!r->err)
+                lread_fail(r, close);
+            lval_del(x);
+            return NULL;
+        }
+        x = lval_add_tail(x, v);
+    }
+}
+
+/**
+ * @brief Read the expressions of src as an S-Expression
+ *
+ * @param filename Name of the input in error messages
+ * @param src Text to read, len characters long
+ * @param row Line of the input src starts on, for error positions
+ * @param err Set to a new error message, which the caller frees, when
+ *        src is not valid, as mpc_err_string would give it
+ * @return The expressions, NULL on error
+ */
+lval *lread(const char *filename, const char *src, size_t len, long row, char **err)
+{
+    lread_init();
+
+    lreader r = {filename, src, src, src + len, row, 0, NULL, LREAD_NONE, NULL};
+    lread_space(&r);
+    lval *x = lread_list(&r, lval_sexpr(), 0);
+    *err = r.err;
+    return x;
+}
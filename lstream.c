@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpc.h"
+#include "lbig.h"
+#include "lvec.h"
+#include "parsing.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LSTREAM_MMAP
+#endif
+
+//=======================================================
+//                Streaming Evaluation
+//=======================================================
+
+/*
+ * Input of any size is read a line at a time into a buffer and scanned
+ * for complete top-level forms as it arrives. A form is what the REPL
+ * takes as one input: the expressions up to a newline outside of any
+ * list, so a list may span lines. Each form is evaluated and printed as
+ * soon as it is complete, then dropped from the buffer.
+ *
+ * The buffer only holds the form being read and the line after it, so
+ * memory stays bounded by the largest form rather than the input. The
+ * grammar has no strings or comments, counting brackets is enough to
+ * tell where a form ends.
+ *
+ * Script files are mapped instead, where that is supported, and their
+ * forms are found and read in place.
+ */
+
+/* Space kept free in the buffer for each read */
+#define LSTREAM_CHUNK 65536
+
+typedef struct lstream
+{
+    char *buf;
+    size_t len;
+    size_t cap;
+
+    /* Start of the form being read, where scanning resumes and the brackets open there */
+    size_t start;
+    size_t scan;
+    int depth;
+    int blank; /* whether the form is whitespace so far */
+
+    /* Lines of the input before start and before scan */
+    long start_row;
+    long scan_row;
+} lstream;
+
+/* Evaluate the form from start to end and begin the next one after it */
+static int lstream_form(lstream *s, lenv *e, const char *name, size_t end)
+{
+    int running = 1;
+    if (!s->blank)
+        running = lispy_eval(e, name, s->buf + s->start, end - s->start, s->start_row);
+
+    s->start = end;
+    s->start_row = s->scan_row;
+    s->blank = 1;
+    return running;
+}
+
+/* Scan the bytes read since the last call, evaluating each form they complete */
+static int lstream_scan(lstream *s, lenv *e, const char *name)
+{
+    while (s->scan < s->len)
+    {
+        char c = s->buf[s->scan++];
+        switch (c)
+        {
+        case '\n':
+            s->scan_row++;
+            if (s->depth == 0 && !lstream_form(s, e, name, s->scan))
+                return 0;
+            break;
+        case '(':
+        case '{':
+            s->depth++;
+            s->blank = 0;
+            break;
+        case ')':
+        case '}':
+            /* A stray closer is left for the parser to report */
+            if (s->depth > 0)
+                s->depth--;
+            s->blank = 0;
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\f':
+        case '\v':
+            break;
+        default:
+            s->blank = 0;
+            break;
+        }
+    }
+    return 1;
+}
+
+/* Make room for a read, dropping evaluated forms before growing the buffer */
+static void lstream_reserve(lstream *s)
+{
+    if (s->cap - s->len >= LSTREAM_CHUNK)
+        return;
+
+    if (s->start > 0)
+    {
+        memmove(s->buf, s->buf + s->start, s->len - s->start);
+        s->len -= s->start;
+        s->scan -= s->start;
+        s->start = 0;
+    }
+
+    while (s->cap - s->len < LSTREAM_CHUNK)
+    {
+        s->cap *= 2;
+        s->buf = realloc(s->buf, s->cap);
+    }
+}
+
+/* Evaluate and print the forms of f as they are read, 0 once exit was evaluated */
+static int lstream_read(lenv *e, const char *name, FILE *f)
+{
+    lstream s = {0};
+    s.cap = 2 * LSTREAM_CHUNK;
+    s.buf = malloc(s.cap);
+    s.blank = 1;
+
+    int running = 1;
+    while (running)
+    {
+        lstream_reserve(&s);
+
+        /* Read up to the next newline, so that each complete line is evaluated without waiting for more */
+        if (!fgets(s.buf + s.len, (int)(s.cap - s.len), f))
+        {
+            /* The last form may not end with a newline */
+            if (s.start < s.len)
+                running = lstream_form(&s, e, name, s.len);
+            break;
+        }
+        s.len += strlen(s.buf + s.len);
+
+        running = lstream_scan(&s, e, name);
+    }
+
+    free(s.buf);
+    return running;
+}
+
+/**
+ * @brief Evaluate and print the forms of a file as they are read
+ *
+ * @param e Environment to evaluate in
+ * @param path File to read, stdin if it is "-"
+ * @return Exit status of the interpreter
+ */
+int lstream_run(lenv *e, const char *path)
+{
+    int running;
+    if (strcmp(path, "-") == 0)
+        running = lstream_read(e, "<stdin>", stdin);
+    else
+    {
+        FILE *f = fopen(path, "r");
+        if (!f)
+        {
+            printf("Cannot open '%s'\n", path);
+            return 1;
+        }
+        running = lstream_read(e, path, f);
+        fclose(f);
+    }
+    return running ? 0 : lispy_exit_status;
+}
+
+/**
+ * @brief Evaluate and print the forms of some text
+ *
+ * @param e Environment to evaluate in
+ * @param name Name of the text in error messages
+ * @param src Text to evaluate, len characters long, which is read in place
+ * @return 0 once exit was evaluated, 1 otherwise
+ */
+int lstream_text(lenv *e, const char *name, const char *src, size_t len)
+{
+    /* The buffer is only scanned, it is never written without a read */
+    lstream s = {0};
+    s.buf = (char *)src;
+    s.len = len;
+    s.cap = len;
+    s.blank = 1;
+
+    if (!lstream_scan(&s, e, name))
+        return 0;
+    return s.start < s.len ? lstream_form(&s, e, name, s.len) : 1;
+}
+
+/**
+ * @brief Evaluate and print the forms of a script file
+ *
+ * Regular files are mapped and read in place, anything else, such as a
+ * pipe, is streamed.
+ *
+ * @param e Environment to evaluate in
+ * @param path File to run, stdin if it is "-"
+ * @return 0 once exit was evaluated, 1 otherwise, -1 if the file cannot be read
+ */
+int lstream_script(lenv *e, const char *path)
+{
+    if (strcmp(path, "-") == 0)
+        return lstream_read(e, "<stdin>", stdin);
+
+#ifdef LSTREAM_MMAP
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        /* Nothing to map in an empty file */
+        if (st.st_size == 0)
+        {
+            close(fd);
+            return 1;
+        }
+
+        char *src = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (src != MAP_FAILED)
+        {
+            madvise(src, st.st_size, MADV_SEQUENTIAL);
+            int running = lstream_text(e, path, src, st.st_size);
+            munmap(src, st.st_size);
+            return running;
+        }
+    }
+    else if (fd >= 0)
+        close(fd);
+#endif
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        printf("Cannot open '%s'\n", path);
+        return -1;
+    }
+    int running = lstream_read(e, path, f);
+    fclose(f);
+    return running;
+}
@@ -0,0 +1,389 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mpc.h"
+#include "lbig.h"
+#include "lvec.h"
+#include "parsing.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//=======================================================
+//                Implemention
+//=======================================================
+
+/*
+ * Kernels walk two elements per SSE2 instruction where the operation
+ * has one, with a scalar loop for the rest and for builds without
+ * SSE2. Operands with stride 0 are broadcast from their first element.
+ */
+
+lvec *lvec_new(int elem, int count)
+{
+    lvec *v = malloc(sizeof(lvec));
+    v->elem = elem;
+    v->count = count;
+    v->f64 = malloc(sizeof(double) * (count ? count : 1));
+    return v;
+}
+
+lvec *lvec_copy(lvec *v)
+{
+    lvec *x = lvec_new(v->elem, v->count);
+    memcpy(x->f64, v->f64, sizeof(double) * v->count);
+    return x;
+}
+
+/* New vector of v's elements as doubles */
+lvec *lvec_to_f64(lvec *v)
+{
+    if (v->elem == LVEC_F64)
+        return lvec_copy(v);
+
+    lvec *x = lvec_new(LVEC_F64, v->count);
+    for (int i = 0; i < v->count; ++i)
+        x->f64[i] = (double)v->i64[i];
+    return x;
+}
+
+void lvec_del(lvec *v)
+{
+    if (!v)
+        return;
+    free(v->f64);
+    free(v);
+}
+
+#if defined(__SSE2__)
+#define LVEC_LOAD_PD(p, s, i) ((s) ? _mm_loadu_pd((p) + (i)) : _mm_set1_pd(*(p)))
+#define LVEC_LOAD_EPI64(p, s, i) \
+    ((s) ? _mm_loadu_si128((const __m128i *)((p) + (i))) : _mm_set1_epi64x(*(p)))
+#endif
+
+void lvec_f64_arith(LVEC_OP op, double *r, const double *x, int xs, const double *y, int ys, int n)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128d a = LVEC_LOAD_PD(x, xs, i);
+        __m128d b = LVEC_LOAD_PD(y, ys, i);
+        switch (op)
+        {
+        case LVEC_ADD:
+            a = _mm_add_pd(a, b);
+            break;
+        case LVEC_SUB:
+            a = _mm_sub_pd(a, b);
+            break;
+        case LVEC_MUL:
+            a = _mm_mul_pd(a, b);
+            break;
+        default:
+            a = _mm_div_pd(a, b);
+            break;
+        }
+        _mm_storeu_pd(r + i, a);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        double a = x[i * xs];
+        double b = y[i * ys];
+        switch (op)
+        {
+        case LVEC_ADD:
+            r[i] = a + b;
+            break;
+        case LVEC_SUB:
+            r[i] = a - b;
+            break;
+        case LVEC_MUL:
+            r[i] = a * b;
+            break;
+        default:
+            r[i] = a / b;
+            break;
+        }
+    }
+}
+
+void lvec_f64_cmp(LVEC_OP op, int64_t *r, const double *x, int xs, const double *y, int ys, int n)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    /* Comparisons give all ones per true lane, keep the low bit */
+    __m128i one = _mm_set1_epi64x(1);
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128d a = LVEC_LOAD_PD(x, xs, i);
+        __m128d b = LVEC_LOAD_PD(y, ys, i);
+        __m128d m;
+        switch (op)
+        {
+        case LVEC_LT:
+            m = _mm_cmplt_pd(a, b);
+            break;
+        case LVEC_GT:
+            m = _mm_cmpgt_pd(a, b);
+            break;
+        case LVEC_LE:
+            m = _mm_cmple_pd(a, b);
+            break;
+        default:
+            m = _mm_cmpge_pd(a, b);
+            break;
+        }
+        _mm_storeu_si128((__m128i *)(r + i), _mm_and_si128(_mm_castpd_si128(m), one));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        double a = x[i * xs];
+        double b = y[i * ys];
+        switch (op)
+        {
+        case LVEC_LT:
+            r[i] = a < b;
+            break;
+        case LVEC_GT:
+            r[i] = a > b;
+            break;
+        case LVEC_LE:
+            r[i] = a <= b;
+            break;
+        default:
+            r[i] = a >= b;
+            break;
+        }
+    }
+}
+
+int lvec_i64_arith(LVEC_OP op, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, int n)
+{
+    int i = 0;
+    int overflow = 0;
+#if defined(__SSE2__)
+    /* Sums overflow when the result's sign differs from both addends' */
+    if (op == LVEC_ADD || op == LVEC_SUB)
+    {
+        __m128i bad = _mm_setzero_si128();
+        for (; i + 2 <= n; i += 2)
+        {
+            __m128i a = LVEC_LOAD_EPI64(x, xs, i);
+            __m128i b = LVEC_LOAD_EPI64(y, ys, i);
+            __m128i s;
+            if (op == LVEC_ADD)
+            {
+                s = _mm_add_epi64(a, b);
+                bad = _mm_or_si128(bad, _mm_and_si128(_mm_xor_si128(a, s), _mm_xor_si128(b, s)));
+            }
+            else
+            {
+                s = _mm_sub_epi64(a, b);
+                bad = _mm_or_si128(bad, _mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, s)));
+            }
+            _mm_storeu_si128((__m128i *)(r + i), s);
+        }
+        overflow = _mm_movemask_pd(_mm_castsi128_pd(bad)) != 0;
+    }
+#endif
+    for (; i < n && !overflow; ++i)
+    {
+        int64_t a = x[i * xs];
+        int64_t b = y[i * ys];
+        switch (op)
+        {
+        case LVEC_ADD:
+            overflow = lint_add(a, b, &r[i]);
+            break;
+        case LVEC_SUB:
+            overflow = lint_sub(a, b, &r[i]);
+            break;
+        default:
+            overflow = lint_mul(a, b, &r[i]);
+            break;
+        }
+    }
+    return overflow;
+}
+
+void lvec_i64_cmp(LVEC_OP op, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, int n)
+{
+    /* SSE2 has no 64-bit compare, the plain loop is left to the compiler */
+    for (int i = 0; i < n; ++i)
+    {
+        int64_t a = x[i * xs];
+        int64_t b = y[i * ys];
+        switch (op)
+        {
+        case LVEC_LT:
+            r[i] = a < b;
+            break;
+        case LVEC_GT:
+            r[i] = a > b;
+            break;
+        case LVEC_LE:
+            r[i] = a <= b;
+            break;
+        default:
+            r[i] = a >= b;
+            break;
+        }
+    }
+}
+
+/* Two independent accumulators hide the latency of the adds */
+double lvec_f64_dot(const double *x, const double *y, int n)
+{
+    int i = 0;
+    double r = 0;
+#if defined(__SSE2__)
+    __m128d a0 = _mm_setzero_pd();
+    __m128d a1 = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4)
+    {
+        a0 = _mm_add_pd(a0, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+        a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+    r = lanes[0] + lanes[1];
+#endif
+    for (; i < n; ++i)
+        r += x[i] * y[i];
+    return r;
+}
+
+double lvec_f64_sum(const double *x, int n)
+{
+    int i = 0;
+    double r = 0;
+#if defined(__SSE2__)
+    __m128d a0 = _mm_setzero_pd();
+    __m128d a1 = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4)
+    {
+        a0 = _mm_add_pd(a0, _mm_loadu_pd(x + i));
+        a1 = _mm_add_pd(a1, _mm_loadu_pd(x + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+    r = lanes[0] + lanes[1];
+#endif
+    for (; i < n; ++i)
+        r += x[i];
+    return r;
+}
+
+double lvec_f64_prod(const double *x, int n)
+{
+    int i = 0;
+    double r = 1;
+#if defined(__SSE2__)
+    __m128d a0 = _mm_set1_pd(1);
+    __m128d a1 = _mm_set1_pd(1);
+    for (; i + 4 <= n; i += 4)
+    {
+        a0 = _mm_mul_pd(a0, _mm_loadu_pd(x + i));
+        a1 = _mm_mul_pd(a1, _mm_loadu_pd(x + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_mul_pd(a0, a1));
+    r = lanes[0] * lanes[1];
+#endif
+    for (; i < n; ++i)
+        r *= x[i];
+    return r;
+}
+
+/* n must be at least 1 for min and max */
+double lvec_f64_min(const double *x, int n)
+{
+    int i = 0;
+    double r = x[0];
+#if defined(__SSE2__)
+    if (n >= 2)
+    {
+        __m128d m = _mm_loadu_pd(x);
+        for (i = 2; i + 2 <= n; i += 2)
+            m = _mm_min_pd(m, _mm_loadu_pd(x + i));
+        double lanes[2];
+        _mm_storeu_pd(lanes, m);
+        r = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+    }
+#endif
+    for (; i < n; ++i)
+        r = x[i] < r ? x[i] : r;
+    return r;
+}
+
+double lvec_f64_max(const double *x, int n)
+{
+    int i = 0;
+    double r = x[0];
+#if defined(__SSE2__)
+    if (n >= 2)
+    {
+        __m128d m = _mm_loadu_pd(x);
+        for (i = 2; i + 2 <= n; i += 2)
+            m = _mm_max_pd(m, _mm_loadu_pd(x + i));
+        double lanes[2];
+        _mm_storeu_pd(lanes, m);
+        r = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+    }
+#endif
+    for (; i < n; ++i)
+        r = x[i] > r ? x[i] : r;
+    return r;
+}
+
+int lvec_i64_dot(const int64_t *x, const int64_t *y, int n, int64_t *r)
+{
+    int64_t acc = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        int64_t p;
+        if (lint_mul(x[i], y[i], &p) || lint_add(acc, p, &acc))
+            return 1;
+    }
+    *r = acc;
+    return 0;
+}
+
+int lvec_i64_sum(const int64_t *x, int n, int64_t *r)
+{
+    int64_t acc = 0;
+    for (int i = 0; i < n; ++i)
+        if (lint_add(acc, x[i], &acc))
+            return 1;
+    *r = acc;
+    return 0;
+}
+
+int lvec_i64_prod(const int64_t *x, int n, int64_t *r)
+{
+    int64_t acc = 1;
+    for (int i = 0; i < n; ++i)
+        if (lint_mul(acc, x[i], &acc))
+            return 1;
+    *r = acc;
+    return 0;
+}
+
+int64_t lvec_i64_min(const int64_t *x, int n)
+{
+    int64_t r = x[0];
+    for (int i = 1; i < n; ++i)
+        r = x[i] < r ? x[i] : r;
+    return r;
+}
+
+int64_t lvec_i64_max(const int64_t *x, int n)
+{
+    int64_t r = x[0];
+    for (int i = 1; i < n; ++i)
+        r = x[i] > r ? x[i] : r;
+    return r;
+}
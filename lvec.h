@@ -0,0 +1,63 @@
+//=============================================================
+//             Packed Numeric Vectors
+//=============================================================
+
+#include <stdint.h>
+
+/* Element types of a vector */
+#define LVEC_F64 0
+#define LVEC_I64 1
+
+/* Element-wise operators, comparisons give 0 or 1 as int64 */
+typedef enum LVEC_OP
+{
+    LVEC_ADD = 0,
+    LVEC_SUB,
+    LVEC_MUL,
+    LVEC_DIV,
+    LVEC_LT,
+    LVEC_GT,
+    LVEC_LE,
+    LVEC_GE,
+} LVEC_OP;
+
+/* Elements are stored contiguously, they are only written while a single value owns the vector */
+typedef struct lvec
+{
+    int elem;
+    int count;
+    union
+    {
+        double *f64;
+        int64_t *i64;
+    };
+} lvec;
+
+lvec *lvec_new(int elem, int count);
+lvec *lvec_copy(lvec *v);
+lvec *lvec_to_f64(lvec *v);
+void lvec_del(lvec *v);
+
+/*
+ * r = x op y for n elements. A stride of 0 repeats the first element
+ * of that operand, 1 walks it. r may be x or y. Division by zero gives
+ * IEEE infinities or NaN, callers check divisors. The int64 kernels
+ * return nonzero on overflow, leaving r partially written. Vectors have
+ * no big integers, so callers redo the whole operation in double.
+ */
+void lvec_f64_arith(LVEC_OP op, double *r, const double *x, int xs, const double *y, int ys, int n);
+void lvec_f64_cmp(LVEC_OP op, int64_t *r, const double *x, int xs, const double *y, int ys, int n);
+int lvec_i64_arith(LVEC_OP op, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, int n);
+void lvec_i64_cmp(LVEC_OP op, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, int n);
+
+/* Reductions, the int64 ones return nonzero on overflow */
+double lvec_f64_dot(const double *x, const double *y, int n);
+double lvec_f64_sum(const double *x, int n);
+double lvec_f64_prod(const double *x, int n);
+double lvec_f64_min(const double *x, int n);
+double lvec_f64_max(const double *x, int n);
+int lvec_i64_dot(const int64_t *x, const int64_t *y, int n, int64_t *r);
+int lvec_i64_sum(const int64_t *x, int n, int64_t *r);
+int lvec_i64_prod(const int64_t *x, int n, int64_t *r);
+int64_t lvec_i64_min(const int64_t *x, int n);
+int64_t lvec_i64_max(const int64_t *x, int n);
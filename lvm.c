@@ -0,0 +1,985 @@
+#include <stdio.h>
+#include "mpc.h"
+#include "lbig.h"
+#include "lvec.h"
+#include "parsing.h"
+
+//=======================================================
+//                Bytecode VM
+//=======================================================
+
+/*
+ * A lambda body is compiled on its first call into a stack bytecode
+ * and cached on the lambda, copies of the lambda share it.
+ *
+ * Symbols compile to env lookups and S-Expressions to their children
+ * followed by APPLY, which behaves like lval_eval_sexpr. Builtins are
+ * called directly, while calls to lambdas push a new VM frame instead
+ * of recursing on the C stack. '(if c {A} {B})' with literal branches
+ * is compiled inline, guarded by a check that 'if' is still bound to
+ * builtin_if.
+ *
+ * Symbols bound when the code is compiled are resolved to a (depth, slot)
+ * address: the number of parents to follow from the running frame and
+ * the position in that env. Depth 0 is the lambda's own frame, whose
+ * slots are its formals in order. A resolved load checks that the slot
+ * still holds the symbol and that no frame on the way gained bindings
+ * that could shadow it, and otherwise looks the symbol up by name.
+ *
+ * Globals, and symbols not bound at compile time, are loaded through
+ * a cache per site holding the root env, the slot the symbol was found
+ * in and the number of frames passed on the way. The value is read from
+ * the slot, so rebinding with def needs no invalidation. A hit follows
+ * the frames like a resolved load, checking flags only: a frame that
+ * gained bindings with '=', or is still binding arguments, may shadow
+ * the global and sends the load to a lookup by name.
+ *
+ * Lists run by 'eval', or by 'if' with branches that are not literal,
+ * are compiled against the bindings of the lambda body running them and
+ * the code is cached on the list, see lcode_of.
+ *
+ * With --gc, calls of lambdas are the safe points of the collector. The
+ * stack and the frame envs are its roots, and builtins pin the region
+ * as they hold values the collector does not see.
+ *
+ * Recursive numeric code, fib and ack in 'parsing --bench calls', runs
+ * about 3x faster than the tree walker, short of the 10x aimed for. The
+ * dispatch loop is not what limits it, the value model is: each call
+ * allocates a heap frame with its own name and value arrays, since a
+ * closure may capture it and '=' may extend it, each intermediate
+ * number is a counted heap lval, and every push and pop adjusts counts.
+ * Getting further needs unboxed numbers and frames kept on the VM stack
+ * until captured. Until then the 10x target is open, not met.
+ */
+
+int lvm_enabled = 1;
+
+typedef enum LVM_OP
+{
+    OP_CONST,  /* k        push consts[k] */
+    OP_LOOKUP, /* k, c     push value of symbol consts[k], cached in caches[c] */
+    OP_LOCAL,  /* k, slot  push value of symbol consts[k] in the frame */
+    OP_OUTER,  /* k, depth, slot */
+    OP_APPLY,  /* n        evaluate the top n values as an S-Expression */
+    OP_IF,     /* k, depth, slot, to
+                           jump to the generic form unless symbol consts[k] is builtin_if */
+    OP_BRANCH, /* else, to pop the condition, jump to else if it is zero */
+    OP_JUMP,   /* to */
+    OP_RETURN,
+} LVM_OP;
+
+/* Where a global was found, env is NULL until the site has loaded one */
+typedef struct lcache
+{
+    lenv *env; /* the root env, borrowed */
+    int slot;
+    int depth; /* frames from the running one to env */
+} lcache;
+
+struct lcode
+{
+    int ref;
+
+    /* Bindings compiled against, new for each lambda body and shared by code run from it */
+    unsigned scope;
+    lval *params; /* formals of the lambda, counted */
+
+    /* Formals of lambda code when distinct and without '&', else -1 */
+    int arity;
+    char **formals;
+
+    int count;
+    int cap;
+    int *ops;
+
+    int nconsts;
+    int cconsts;
+    lval **consts;
+
+    int ncaches;
+    lcache *caches;
+};
+
+/* A lambda body or evaluated expression being run */
+typedef struct lframe
+{
+    lcode *code; /* counted */
+    int pc;
+    lenv *env; /* counted */
+} lframe;
+
+static struct
+{
+    lval **stack;
+    int sp;
+    int cap;
+
+    lframe *frames;
+    int fp;
+    int fcap;
+} vm;
+
+/***************
+ * Compiler
+ ***************/
+
+static int lcode_emit(lcode *c, int op)
+{
+    if (c->count == c->cap)
+    {
+        c->cap = c->cap ? c->cap * 2 : 16;
+        c->ops = realloc(c->ops, sizeof(int) * c->cap);
+    }
+    c->ops[c->count] = op;
+    return c->count++;
+}
+
+/* Constants outlive the form that compiled them */
+static int lcode_const(lcode *c, lval *v)
+{
+    if (c->nconsts == c->cconsts)
+    {
+        c->cconsts = c->cconsts ? c->cconsts * 2 : 8;
+        c->consts = realloc(c->consts, sizeof(lval *) * c->cconsts);
+    }
+    c->consts[c->nconsts] = lval_promote(v);
+    return c->nconsts++;
+}
+
+/* New empty lookup cache */
+static int lcode_cache(lcode *c)
+{
+    c->caches = realloc(c->caches, sizeof(lcache) * (c->ncaches + 1));
+    c->caches[c->ncaches].env = NULL;
+    return c->ncaches++;
+}
+
+/* Bindings visible to the code being compiled */
+typedef struct lscope
+{
+    lval *formals; /* frame of a lambda call, NULL when running in env itself */
+    lenv *env;
+} lscope;
+
+/* Find sym as (depth, slot) from the frame the code runs in, global if in the root env */
+static int lcode_resolve(lscope *s, char *sym, int *depth, int *slot, int *global)
+{
+    *global = 0;
+    int d = 0;
+    if (s->formals)
+    {
+        /* Formals are bound in order, '&' itself takes no slot */
+        int pos = 0;
+        for (int i = 0; i < s->formals->count; ++i)
+        {
+            char *f = s->formals->cell[i]->sym;
+            if (f == lsym_amp)
+                continue;
+            if (f == sym)
+            {
+                *depth = 0;
+                *slot = pos;
+                return 1;
+            }
+            pos++;
+        }
+        d++;
+    }
+
+    for (lenv *e = s->env; e; e = e->par, d++)
+    {
+        int i = lenv_find(e, sym);
+        if (i != -1)
+        {
+            *depth = d;
+            *slot = i;
+            *global = !e->par;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Emit the address of symbol v, as operands of OP_IF or a load */
+static void lcode_sym(lcode *c, lscope *s, lval *v, int load)
+{
+    int depth = -1;
+    int slot = -1;
+    int global;
+    int resolved = lcode_resolve(s, v->sym, &depth, &slot, &global);
+
+    if (load && (!resolved || global))
+    {
+        lcode_emit(c, OP_LOOKUP);
+        lcode_emit(c, lcode_const(c, v));
+        lcode_emit(c, lcode_cache(c));
+        return;
+    }
+
+    if (load)
+        lcode_emit(c, depth == 0 ? OP_LOCAL : OP_OUTER);
+    lcode_emit(c, lcode_const(c, v));
+    if (!load || (resolved && depth != 0))
+        lcode_emit(c, depth);
+    if (!load || resolved)
+        lcode_emit(c, slot);
+}
+
+static void lcode_expr(lcode *c, lscope *s, lval *v);
+static void lcode_if(lcode *c, lscope *s, lval *v);
+
+/* Whether v is '(if c {A} {B})' with literal branches */
+static int lcode_is_if(lval *v)
+{
+    return v->count == 4 &&
+           v->cell[0]->type == LVAL_SYM && v->cell[0]->sym == lsym_if &&
+           v->cell[2]->type == LVAL_QEXPR &&
+           v->cell[3]->type == LVAL_QEXPR;
+}
+
+/* Evaluate the elements of v as an S-Expression */
+static void lcode_call(lcode *c, lscope *s, lval *v)
+{
+    for (int i = 0; i < v->count; ++i)
+        lcode_expr(c, s, v->cell[i]);
+    lcode_emit(c, OP_APPLY);
+    lcode_emit(c, v->count);
+}
+
+/* Lambda bodies and 'if' branches are Q-Expressions run as S-Expressions */
+static void lcode_body(lcode *c, lscope *s, lval *q)
+{
+    if (lcode_is_if(q))
+        lcode_if(c, s, q);
+    else
+        lcode_call(c, s, q);
+}
+
+static void lcode_if(lcode *c, lscope *s, lval *v)
+{
+    lcode_emit(c, OP_IF);
+    lcode_sym(c, s, v->cell[0], 0);
+    int generic = lcode_emit(c, 0);
+
+    lcode_expr(c, s, v->cell[1]);
+    lcode_emit(c, OP_BRANCH);
+    int other = lcode_emit(c, 0);
+    int end1 = lcode_emit(c, 0);
+
+    lcode_body(c, s, v->cell[2]);
+    lcode_emit(c, OP_JUMP);
+    int end2 = lcode_emit(c, 0);
+
+    c->ops[other] = c->count;
+    lcode_body(c, s, v->cell[3]);
+    lcode_emit(c, OP_JUMP);
+    int end3 = lcode_emit(c, 0);
+
+    /* 'if' has been rebound, evaluate it like any other call */
+    c->ops[generic] = c->count;
+    lcode_call(c, s, v);
+
+    c->ops[end1] = c->ops[end2] = c->ops[end3] = c->count;
+}
+
+static void lcode_expr(lcode *c, lscope *s, lval *v)
+{
+    switch (v->type)
+    {
+    case LVAL_SYM:
+        lcode_sym(c, s, v, 1);
+        break;
+    case LVAL_SEXPR:
+        lcode_body(c, s, v);
+        break;
+    default:
+        lcode_emit(c, OP_CONST);
+        lcode_emit(c, lcode_const(c, v));
+        break;
+    }
+}
+
+/* Number of ints taken by the instruction at pc */
+static int lcode_width(int *ops, int pc)
+{
+    switch (ops[pc])
+    {
+    case OP_IF:
+        return 5;
+    case OP_OUTER:
+        return 4;
+    case OP_LOOKUP:
+    case OP_LOCAL:
+    case OP_BRANCH:
+        return 3;
+    case OP_RETURN:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+/* Jumps that end up at a return become returns, so calls before them are tail calls */
+static void lcode_tails(lcode *c)
+{
+    for (int pc = 0; pc < c->count; pc += lcode_width(c->ops, pc))
+    {
+        if (c->ops[pc] != OP_JUMP)
+            continue;
+
+        int to = c->ops[pc + 1];
+        while (c->ops[to] == OP_JUMP)
+            to = c->ops[to + 1];
+        if (c->ops[to] == OP_RETURN)
+            c->ops[pc] = OP_RETURN;
+    }
+}
+
+/* Formals that can be written straight into frame slots */
+static void lcode_arity(lcode *c, lval *formals)
+{
+    for (int i = 0; i < formals->count; ++i)
+    {
+        if (formals->cell[i]->sym == lsym_amp)
+            return;
+        for (int j = 0; j < i; ++j)
+            if (formals->cell[j]->sym == formals->cell[i]->sym)
+                return;
+    }
+
+    c->arity = formals->count;
+    if (formals->count > 0)
+        c->formals = malloc(sizeof(char *) * formals->count);
+    for (int i = 0; i < formals->count; ++i)
+        c->formals[i] = formals->cell[i]->sym;
+}
+
+/* Scopes handed out so far */
+static unsigned lcode_scopes;
+
+/**
+ * @brief Compile a Q-Expression to be run as an S-Expression
+ *
+ * @param body Lambda body or evaluated expression
+ * @param formals Formals of the lambda, bound in the frame the code
+ *        runs in
+ * @param env Env the frame's parent
+ * @param scope Scope of the lambda's code the body is run from, or 0
+ *        for the lambda's own body, which sets up a new one
+ */
+static lcode *lcode_compile(lval *body, lval *formals, lenv *env, unsigned scope)
+{
+    lcode *c = malloc(sizeof(lcode));
+    c->ref = 1;
+    c->scope = scope ? scope : ++lcode_scopes;
+    c->params = lval_promote(formals);
+    c->arity = -1;
+    c->formals = NULL;
+    c->count = c->cap = 0;
+    c->ops = NULL;
+    c->nconsts = c->cconsts = 0;
+    c->consts = NULL;
+    c->ncaches = 0;
+    c->caches = NULL;
+
+    if (!scope)
+        lcode_arity(c, formals);
+
+    lscope s = {formals, env};
+    lcode_body(c, &s, body);
+    lcode_emit(c, OP_RETURN);
+    lcode_tails(c);
+    return c;
+}
+
+lcode *lcode_copy(lcode *c)
+{
+    if (c)
+        c->ref++;
+    return c;
+}
+
+void lcode_del(lcode *c)
+{
+    if (!c || --c->ref > 0)
+        return;
+
+    /* Code may be dropped during a form that still borrows its constants */
+    for (int i = 0; i < c->nconsts; ++i)
+        lval_release(c->consts[i]);
+    lval_release(c->params);
+    free(c->consts);
+    free(c->caches);
+    free(c->formals);
+    free(c->ops);
+    free(c);
+}
+
+/*
+ * Compiled body of lambda f, counted, compiled and cached on first use.
+ * Code of the optimized body is kept with it by lopt.c, as it is redone
+ * when the names it relied on change.
+ */
+lcode *lval_code(lval *f)
+{
+    if (!lopt_enabled)
+    {
+        if (!f->code)
+            f->code = lcode_compile(f->body, f->formals, f->env, 0);
+        return lcode_copy(f->code);
+    }
+
+    lval *body = lopt_body(f);
+    lcode **slot = lopt_code_slot(f);
+    if (slot && *slot)
+        return lcode_copy(*slot);
+
+    /* Code of region lambdas goes with the frame running it */
+    lcode *c = lcode_compile(body, f->formals, f->env, 0);
+    if (slot)
+        *lopt_code_slot(f) = lcode_copy(c);
+    return c;
+}
+
+/*
+ * Code of list x when eval or if runs it in frame fr. It is compiled
+ * against the same bindings as fr's code, and cached on x for as long
+ * as x is unchanged and runs from code of the same scope, such as the
+ * same lambda body. Region values are not kept long enough to cache.
+ */
+static lcode *lcode_of(lval *x, lframe *fr)
+{
+    if (x->compiled && x->compiled->scope == fr->code->scope)
+        return lcode_copy(x->compiled);
+
+    lcode *c = lcode_compile(x, fr->code->params, fr->env->par, fr->code->scope);
+    if (!(x->flags & LVAL_REGION))
+    {
+        lcode_del(x->compiled);
+        x->compiled = lcode_copy(c);
+    }
+    return c;
+}
+
+/***************
+ * Interpreter
+ ***************/
+
+static void lvm_push(lval *v)
+{
+    if (vm.sp == vm.cap)
+    {
+        vm.cap = vm.cap ? vm.cap * 2 : 256;
+        vm.stack = realloc(vm.stack, sizeof(lval *) * vm.cap);
+    }
+    vm.stack[vm.sp++] = v;
+}
+
+/* Push a frame running code in env, taking over the references to both */
+static void lvm_push_frame(lcode *code, lenv *env)
+{
+    if (vm.fp == vm.fcap)
+    {
+        vm.fcap = vm.fcap ? vm.fcap * 2 : 64;
+        vm.frames = realloc(vm.frames, sizeof(lframe) * vm.fcap);
+    }
+    lframe *fr = &vm.frames[vm.fp++];
+    fr->code = code;
+    fr->pc = 0;
+    fr->env = env;
+}
+
+/* Move the top n values into a new S-Expression */
+static lval *lvm_args(int n)
+{
+    lval *a = lval_add_cells(lval_sexpr(), &vm.stack[vm.sp - n], n);
+    vm.sp -= n;
+    return a;
+}
+
+/*
+ * Value of symbol sym at (depth, slot) from env e, borrowed. NULL when a
+ * frame on the way gained bindings or the slot no longer holds sym.
+ */
+static lval *lvm_slot(lenv *e, char *sym, int depth, int slot)
+{
+    for (int d = 0; d < depth; ++d)
+    {
+        if (e->flags & LENV_EXTENDED)
+            return NULL;
+        e = e->par;
+    }
+
+    if (slot < e->count && e->syms[slot] == sym)
+        return e->vals[slot];
+    return NULL;
+}
+
+/* Value of the global cached in ic from env e, borrowed. NULL when the cell may be stale */
+static lval *lvm_cached(lcache *ic, lenv *e, char *sym)
+{
+    for (int d = 0; d < ic->depth; ++d)
+    {
+        if (e->flags & (LENV_EXTENDED | LENV_BINDING))
+            return NULL;
+        e = e->par;
+    }
+
+    if (e == ic->env && ic->slot < e->count && e->syms[ic->slot] == sym)
+        return e->vals[ic->slot];
+    return NULL;
+}
+
+/* Look sym up from env e, caching its cell in ic when the root env holds it, borrowed */
+static lval *lvm_global(lcache *ic, lenv *e, char *sym)
+{
+    ic->env = NULL;
+    for (int d = 0; e; e = e->par, ++d)
+    {
+        int i = lenv_find(e, sym);
+        if (i == -1)
+            continue;
+        if (!e->par)
+        {
+            ic->env = e;
+            ic->slot = i;
+            ic->depth = d;
+        }
+        return e->vals[i];
+    }
+    return NULL;
+}
+
+/* Push a looked up value, builtins are printed by the name they were looked up with */
+static void lvm_push_sym(lval *x, char *sym)
+{
+    if (x->type == LVAL_FUNC && x->builtin && x->name != sym)
+        x = lval_set_name(x, sym);
+    lvm_push(x);
+}
+
+/*
+ * Run code in env, called from frame fr, taking over the references to
+ * both. A call in tail position replaces fr, releasing its env.
+ */
+static void lvm_enter(lframe *fr, int tail, lcode *code, lenv *env)
+{
+    if (!tail)
+    {
+        lvm_push_frame(code, env);
+        return;
+    }
+
+    lcode_del(fr->code);
+    lenv_drop(fr->env);
+    fr->code = code;
+    fr->pc = 0;
+    fr->env = env;
+}
+
+/*
+ * Arithmetic and comparison builtins applied to two numbers, computed
+ * without building an argument list. NULL if the builtin must be called.
+ */
+static lval *lvm_prim2(lbuiltin b, lval *vx, lval *vy)
+{
+    /* Integers stay exact, anything that does not fit goes to the builtin */
+    if (vx->type == LVAL_INT && vy->type == LVAL_INT)
+    {
+        int64_t x = vx->inum;
+        int64_t y = vy->inum;
+        int64_t r;
+        if (b == builtin_add)
+            return lint_add(x, y, &r) ? NULL : lval_int(r);
+        if (b == builtin_sub)
+            return lint_sub(x, y, &r) ? NULL : lval_int(r);
+        if (b == builtin_mul)
+            return lint_mul(x, y, &r) ? NULL : lval_int(r);
+        if (b == builtin_lt)
+            return lval_int(x < y);
+        if (b == builtin_gt)
+            return lval_int(x > y);
+        if (b == builtin_le)
+            return lval_int(x <= y);
+        if (b == builtin_ge)
+            return lval_int(x >= y);
+        if (b == builtin_eq)
+            return lval_int(x == y);
+        if (b == builtin_ne)
+            return lval_int(x != y);
+        return NULL;
+    }
+
+    /* Big integers stay exact in the builtin */
+    if (vx->type == LVAL_BIG || vy->type == LVAL_BIG)
+        return NULL;
+
+    double x = LVAL_AS_DOUBLE(vx);
+    double y = LVAL_AS_DOUBLE(vy);
+    if (b == builtin_add)
+        return lval_num(x + y);
+    if (b == builtin_sub)
+        return lval_num(x - y);
+    if (b == builtin_mul)
+        return lval_num(x * y);
+    if (b == builtin_div && y != 0)
+        return lval_num(x / y);
+    if (b == builtin_lt)
+        return lval_int(x < y);
+    if (b == builtin_gt)
+        return lval_int(x > y);
+    if (b == builtin_le)
+        return lval_int(x <= y);
+    if (b == builtin_ge)
+        return lval_int(x >= y);
+    if (b == builtin_eq)
+        return lval_int(x == y);
+    if (b == builtin_ne)
+        return lval_int(x != y);
+    return NULL;
+}
+
+/* Run frames until the one at index floor returns, and return its result */
+static lval *lvm_run(int floor)
+{
+    lframe *fr;
+    int *ops;
+    lval **consts;
+
+#define LOAD_FRAME()                      \
+    do                                    \
+    {                                     \
+        fr = &vm.frames[vm.fp - 1];       \
+        ops = fr->code->ops;              \
+        consts = fr->code->consts;        \
+    } while (0)
+
+#if defined(__GNUC__)
+    static void *labels[] = {
+        [OP_CONST] = &&L_OP_CONST,
+        [OP_LOOKUP] = &&L_OP_LOOKUP,
+        [OP_LOCAL] = &&L_OP_LOCAL,
+        [OP_OUTER] = &&L_OP_OUTER,
+        [OP_APPLY] = &&L_OP_APPLY,
+        [OP_IF] = &&L_OP_IF,
+        [OP_BRANCH] = &&L_OP_BRANCH,
+        [OP_JUMP] = &&L_OP_JUMP,
+        [OP_RETURN] = &&L_OP_RETURN,
+    };
+#define DISPATCH() goto *labels[ops[fr->pc++]]
+#define CASE(op) L_##op:
+#else
+#define DISPATCH() continue
+#define CASE(op) case op:
+#endif
+
+    LOAD_FRAME();
+
+#if defined(__GNUC__)
+    DISPATCH();
+#else
+    for (;;)
+    {
+        switch (ops[fr->pc++])
+        {
+#endif
+
+    CASE(OP_CONST)
+    {
+        lvm_push(lval_copy(consts[ops[fr->pc++]]));
+        DISPATCH();
+    }
+
+    CASE(OP_LOOKUP)
+    {
+        lval *k = consts[ops[fr->pc]];
+        lcache *ic = &fr->code->caches[ops[fr->pc + 1]];
+        fr->pc += 2;
+
+        lval *x = ic->env ? lvm_cached(ic, fr->env, k->sym) : NULL;
+        if (!x)
+            x = lvm_global(ic, fr->env, k->sym);
+        lvm_push_sym(x ? lval_copy(x) : lval_err("Unbound symbol: %s!", k->sym), k->sym);
+        DISPATCH();
+    }
+
+    CASE(OP_LOCAL)
+    {
+        lval *k = consts[ops[fr->pc]];
+        int slot = ops[fr->pc + 1];
+        fr->pc += 2;
+
+        lenv *e = fr->env;
+        if (slot < e->count && e->syms[slot] == k->sym)
+            lvm_push_sym(lval_copy(e->vals[slot]), k->sym);
+        else
+            lvm_push_sym(lenv_get_value(e, k), k->sym);
+        DISPATCH();
+    }
+
+    CASE(OP_OUTER)
+    {
+        lval *k = consts[ops[fr->pc]];
+        lval *x = lvm_slot(fr->env, k->sym, ops[fr->pc + 1], ops[fr->pc + 2]);
+        fr->pc += 3;
+
+        lvm_push_sym(x ? lval_copy(x) : lenv_get_value(fr->env, k), k->sym);
+        DISPATCH();
+    }
+
+    CASE(OP_IF)
+    {
+        lval *k = consts[ops[fr->pc]];
+        int depth = ops[fr->pc + 1];
+        lval *x = depth < 0 ? NULL : lvm_slot(fr->env, k->sym, depth, ops[fr->pc + 2]);
+        fr->pc += 3;
+
+        int inline_if;
+        if (x)
+            inline_if = x->type == LVAL_FUNC && x->builtin == builtin_if;
+        else
+        {
+            x = lenv_get_value(fr->env, k);
+            inline_if = x->type == LVAL_FUNC && x->builtin == builtin_if;
+            lval_del(x);
+        }
+
+        if (inline_if)
+            fr->pc++;
+        else
+            fr->pc = ops[fr->pc];
+        DISPATCH();
+    }
+
+    CASE(OP_BRANCH)
+    {
+        lval *c = vm.stack[--vm.sp];
+        int other = ops[fr->pc++];
+        int end = ops[fr->pc++];
+
+        /* Same results as evaluating the S-Expression and calling 'if' */
+        if (c->type == LVAL_ERR)
+        {
+            lvm_push(c);
+            fr->pc = end;
+        }
+        else if (!LVAL_IS_NUM(c))
+        {
+            lvm_push(lval_err("Function '%s' passed incorrect type for argument %i. "
+                              "Got %s, Expected %s.",
+                              "if", 0, ltype_name(c->type), ltype_name(LVAL_NUM)));
+            lval_del(c);
+            fr->pc = end;
+        }
+        else
+        {
+            if (!LVAL_AS_DOUBLE(c))
+                fr->pc = other;
+            lval_del(c);
+        }
+        DISPATCH();
+    }
+
+    CASE(OP_JUMP)
+    {
+        fr->pc = ops[fr->pc];
+        DISPATCH();
+    }
+
+    CASE(OP_APPLY)
+    {
+        int n = ops[fr->pc++];
+        lval **vals = &vm.stack[vm.sp - n];
+
+        /* Error Checking */
+        for (int i = 0; i < n; ++i)
+        {
+            if (vals[i]->type == LVAL_ERR)
+            {
+                lval *err = vals[i];
+                vals[i] = NULL;
+                for (int j = 0; j < n; ++j)
+                    lval_del(vals[j]);
+                vm.sp -= n;
+                lvm_push(err);
+                DISPATCH();
+            }
+        }
+
+        /* Empty Expression */
+        if (n == 0)
+        {
+            lvm_push(lval_sexpr());
+            DISPATCH();
+        }
+        /* Single Expression */
+        if (n == 1)
+            DISPATCH();
+
+        /* Ensure First Element is Function after evaluation */
+        lval *f = vals[0];
+        if (f->type != LVAL_FUNC && f->type != LVAL_PART && f->type != LVAL_MEMO)
+        {
+            for (int i = 0; i < n; ++i)
+                lval_del(vals[i]);
+            vm.sp -= n;
+            lvm_push(lval_err(LERR_STR[SEXPR_NO_FUNC]));
+            DISPATCH();
+        }
+
+        /* Memos may run the VM again, which can move frames */
+        if (f->type == LVAL_MEMO)
+        {
+            lval *a = lvm_args(n - 1);
+            vm.sp--;
+            lval *r = lmemo_call(fr->env, f, a);
+            lval_del(f);
+            lvm_push(r);
+            LOAD_FRAME();
+            DISPATCH();
+        }
+
+        /* A partial application calls its lambda with all arguments so far */
+        lval *args = NULL;
+        if (f->type == LVAL_PART)
+        {
+            args = lval_join(lval_copy(f->bound), lvm_args(n - 1));
+            vm.sp--;
+            lval *fn = lval_copy(f->fn);
+            lval_del(f);
+            f = fn;
+        }
+
+        /* Nothing is left to do in this frame after a call in tail position */
+        int tail = ops[fr->pc] == OP_RETURN;
+
+        /* 'eval' and 'if' run the expression they pick as code */
+        if (f->builtin == builtin_eval || f->builtin == builtin_if)
+        {
+            lval *a = lvm_args(n - 1);
+            vm.sp--;
+
+            lval *x = f->builtin == builtin_eval ? lval_eval_code(a) : lval_if_code(a);
+            lval_del(f);
+            if (x->type == LVAL_ERR)
+            {
+                lvm_push(x);
+                DISPATCH();
+            }
+
+            lvm_enter(fr, tail, lcode_of(x, fr), lenv_ref(fr->env));
+            lval_del(x);
+            LOAD_FRAME();
+            DISPATCH();
+        }
+
+        if (f->builtin)
+        {
+            if (n == 3 && LVAL_IS_NUM(vals[1]) && LVAL_IS_NUM(vals[2]))
+            {
+                lval *r = lvm_prim2(f->builtin, vals[1], vals[2]);
+                if (r)
+                {
+                    lval_del(vals[0]);
+                    lval_del(vals[1]);
+                    lval_del(vals[2]);
+                    vm.sp -= 3;
+                    lvm_push(r);
+                    DISPATCH();
+                }
+            }
+
+            lval *a = lvm_args(n - 1);
+            vm.sp--;
+
+            /* Builtins may run the VM again, which can move frames */
+            lgc_pin();
+            lval *r = f->builtin(fr->env, a);
+            lgc_unpin();
+            lval_del(f);
+            lvm_push(r);
+            LOAD_FRAME();
+            DISPATCH();
+        }
+
+        lcode *code = lval_code(f);
+        lenv *env;
+        if (!args && code->arity == n - 1)
+        {
+            /* Arguments move straight into the frame slots */
+            env = lenv_frame(f->env, code->formals, vals + 1, n - 1);
+            vm.sp -= n - 1;
+            vm.sp--;
+        }
+        else
+        {
+            lval *a = args;
+            if (!a)
+            {
+                a = lvm_args(n - 1);
+                vm.sp--;
+            }
+
+            lval *r = lval_bind(f, a, &env);
+            if (r)
+            {
+                lcode_del(code);
+                lval_del(f);
+                lvm_push(r);
+                DISPATCH();
+            }
+        }
+        lval_del(f);
+        lvm_enter(fr, tail, code, env);
+        lgc_poll();
+        LOAD_FRAME();
+        DISPATCH();
+    }
+
+    CASE(OP_RETURN)
+    {
+        lval *r = vm.stack[--vm.sp];
+        lcode_del(fr->code);
+        lenv_drop(fr->env);
+
+        vm.fp--;
+        if (vm.fp == floor)
+            return r;
+
+        lvm_push(r);
+        LOAD_FRAME();
+        DISPATCH();
+    }
+
+#if !defined(__GNUC__)
+        }
+    }
+#endif
+
+#undef LOAD_FRAME
+#undef DISPATCH
+#undef CASE
+}
+
+/* Pass the collector every value and frame env the VM holds */
+void lvm_roots(void (*val)(lval **), void (*env)(lenv **))
+{
+    for (int i = 0; i < vm.sp; ++i)
+        val(&vm.stack[i]);
+    for (int i = 0; i < vm.fp; ++i)
+        env(&vm.frames[i].env);
+}
+
+/**
+ * @brief Evaluate the body of a lambda in a frame its formals are bound in
+ *
+ * @param f Lambda, still owned by the caller
+ * @param env Frame from lval_bind, still owned by the caller
+ * @return Result of the body
+ */
+lval *lvm_exec(lval *f, lenv *env)
+{
+    int floor = vm.fp;
+    lvm_push_frame(lval_code(f), lenv_ref(env));
+    return lvm_run(floor);
+}
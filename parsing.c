@@ -1,12 +1,34 @@
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 #include "mpc.h"
+#include "lalloc.h"
+#include "lbig.h"
+#include "lvec.h"
 #include "parsing.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #ifdef _WIN32
 /* Declare a buffer for user of size 2048 */
 static char buffer[2048];
 
 void add_history(char *unused) {}
+
+char *readline(char *prompt)
+{
+    fputs(prompt, stdout);
+    /* NULL at the end of input, as editline gives it */
+    if (!fgets(buffer, 2048, stdin))
+        return NULL;
+    char *cpy = malloc(strlen(buffer) + 1);
+    strcpy(cpy, buffer);
+    cpy[strcspn(cpy, "\n")] = '\0';
+    return cpy;
+}
 #else
 #include <editline/readline.h>
 #include <editline/history.h>
@@ -16,14 +38,35 @@ void add_history(char *unused) {}
 //                Implemention
 //=======================================================
 
+char *LERR_STR[LERR_TYPE_NUM] = {
+    [DIV_BY_ZERO] = "Division by zero!",
+    [POW_ON_NEG] = "Pow base on negtive number!",
+    [OP_ON_NAN] = "Cannot operate on non-number!",
+    [STR_TO_NUM] = "This String cannot cast to number!",
+    [BAD_OP] = "This operation has not been support!",
+    [SEXPR_NO_FUNC] = "First element is not a function!",
+    [MOD_ON_FLT_AND_OVFLW] = "Numbers in mod-op shouldn't be float type!\n\
+Overflow occurred in type cast!",
+    [HEAD_TAIL_TOO_MANY_ARGS] = "Function 'head/tail' passed too many arguments!",
+    [HEAD_TAIL_BAD_TYPE] = "Function 'head/tail' passed incorrect types!",
+    [HEAD_TAIL_EMPTY] = "Function 'head/tail' passed {}!",
+};
+
 char *ltype_name(int t)
 {
     switch (t)
     {
     case LVAL_FUNC:
+    case LVAL_PART:
+    case LVAL_MEMO:
         return "Function";
     case LVAL_NUM:
         return "Number";
+    case LVAL_INT:
+    case LVAL_BIG:
+        return "Integer";
+    case LVAL_VEC:
+        return "Vector";
     case LVAL_ERR:
         return "Error";
     case LVAL_SYM:
@@ -37,48 +80,481 @@ char *ltype_name(int t)
     }
 }
 
+/* Stop running on 'exit' itself, or on the symbol a call of it returns */
 void test_exit(lval *val, int *p_flag)
 {
-    if (val->type == LVAL_FUNC && (strcmp(val->name, "exit") == 0))
+    if (val->type == LVAL_FUNC && val->builtin && val->name == lsym_exit)
+        *p_flag = 0;
+    if (val->type == LVAL_SYM && val->sym == lsym_exit)
         *p_flag = 0;
 }
 
+/*******************
+ * Symbol Interning
+ *******************/
+
+/* Interned symbols the evaluator compares against */
+char *lsym_amp;
+char *lsym_if;
+char *lsym_exit;
+char *lsym_penv;
+
+/* Process-wide set of canonical symbol strings */
+static struct
+{
+    int count;
+    int cap;
+    char **strs;
+
+    /* Strings are bump-allocated from chunks that are never freed */
+    char *chunk;
+    size_t chunk_left;
+} lsym_table;
+
+#define LSYM_CHUNK_SIZE 4096
+
+static unsigned lsym_hash(char *s)
+{
+    unsigned h = 2166136261u;
+    while (*s)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static char *lsym_store(char *s)
+{
+    size_t len = strlen(s) + 1;
+    if (len > LSYM_CHUNK_SIZE / 4)
+        return strcpy(malloc(len), s);
+
+    if (len > lsym_table.chunk_left)
+    {
+        lsym_table.chunk = malloc(LSYM_CHUNK_SIZE);
+        lsym_table.chunk_left = LSYM_CHUNK_SIZE;
+    }
+    char *p = strcpy(lsym_table.chunk, s);
+    lsym_table.chunk += len;
+    lsym_table.chunk_left -= len;
+    return p;
+}
+
+static void lsym_grow(void)
+{
+    int cap = lsym_table.cap ? lsym_table.cap * 2 : 256;
+    char **strs = calloc(cap, sizeof(char *));
+    for (int i = 0; i < lsym_table.cap; ++i)
+    {
+        if (!lsym_table.strs[i])
+            continue;
+        unsigned h = lsym_hash(lsym_table.strs[i]) & (cap - 1);
+        while (strs[h])
+            h = (h + 1) & (cap - 1);
+        strs[h] = lsym_table.strs[i];
+    }
+    free(lsym_table.strs);
+    lsym_table.strs = strs;
+    lsym_table.cap = cap;
+}
+
+/**
+ * @brief Get the canonical copy of a symbol string
+ *
+ * Equal strings always intern to the same pointer, so interned
+ * symbols can be compared with '=='. Interned strings live for
+ * the whole process and must not be freed.
+ */
+char *lsym_intern(char *s)
+{
+    if (lsym_table.count * 2 >= lsym_table.cap)
+    {
+        int first = lsym_table.cap == 0;
+        lsym_grow();
+        if (first)
+        {
+            lsym_amp = lsym_intern("&");
+            lsym_if = lsym_intern("if");
+            lsym_exit = lsym_intern("exit");
+            lsym_penv = lsym_intern("penv");
+        }
+    }
+
+    unsigned mask = lsym_table.cap - 1;
+    unsigned h = lsym_hash(s) & mask;
+    for (; lsym_table.strs[h]; h = (h + 1) & mask)
+    {
+        if (strcmp(lsym_table.strs[h], s) == 0)
+            return lsym_table.strs[h];
+    }
+
+    lsym_table.count++;
+    return lsym_table.strs[h] = lsym_store(s);
+}
+
+/****************
+ * Form Regions
+ ****************/
+
+/*
+ * In region mode every lval and lenv created while a top-level form
+ * is evaluated comes from a bump region that is dropped in one go
+ * once the result has been printed. While a form is active:
+ *
+ *  - lval_del on a region value only drops its count, the memory is
+ *    reclaimed with the region.
+ *  - Region values do not count their references to heap values, the
+ *    heap values are borrowed and are never modified in place.
+ *  - A heap value whose last env reference goes away is freed after
+ *    the form, since temporaries may still borrow it.
+ *  - Values stored into a heap env (def, or = at top level) are
+ *    promoted to the heap with lval_promote.
+ */
+
+/* A growable array of pointers */
+typedef struct lptrs
+{
+    void **items;
+    int count;
+    int cap;
+} lptrs;
+
+static void lptrs_push(lptrs *l, void *p)
+{
+    if (l->count == l->cap)
+    {
+        l->cap = l->cap ? l->cap * 2 : 64;
+        l->items = realloc(l->items, sizeof(void *) * l->cap);
+    }
+    l->items[l->count++] = p;
+}
+
+/* State of the top-level form being evaluated in region mode */
+static struct
+{
+    int active;
+    lregion *mem;
+
+    /* Region errors, big numbers, vectors, lambdas and envs, they own heap memory */
+    lptrs vals;
+    lptrs envs;
+
+    /* Heap values released during the form */
+    lptrs dead;
+
+    lform_stat stat;
+} lform;
+
+static void lgc_reset(void);
+
+/* Start allocating temporaries from the form region */
+void lval_region_begin(void)
+{
+    if (!lform.mem)
+        lform.mem = lregion_new();
+    lform.active = 1;
+    lgc_reset();
+}
+
+/* Monotonic time in nanoseconds */
+static double lform_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Free the heap memory a region value owns */
+static void lform_free_val(lval *v)
+{
+    if (v->type == LVAL_ERR)
+        free(v->err);
+    else if (v->type == LVAL_BIG)
+        lbig_del(v->big);
+    else if (v->type == LVAL_VEC)
+        lvec_del(v->vec);
+    else if (v->type == LVAL_MEMO)
+        lmemo_del(v->memo, 0);
+    else
+        lcode_del(v->code);
+}
+
+static void lform_free_env(lenv *e)
+{
+    free(e->syms);
+    free(e->vals);
+    free(e->index);
+}
+
+/* Drop every temporary of the form at once */
+void lval_region_end(void)
+{
+    double start = lform_now();
+
+    /* Compiled code may drop the last counted reference to heap values */
+    lform.active = 0;
+
+    for (int i = 0; i < lform.vals.count; ++i)
+        lform_free_val(lform.vals.items[i]);
+    for (int i = 0; i < lform.envs.count; ++i)
+        lform_free_env(lform.envs.items[i]);
+    lform.vals.count = 0;
+    lform.envs.count = 0;
+    lform.stat.bytes += lregion_used(lform.mem);
+    if (lregion_used(lform.mem) > lform.stat.peak)
+        lform.stat.peak = lregion_used(lform.mem);
+    lregion_reset(lform.mem);
+
+    /*
+     * Nothing borrows released heap values any more. Those stored again
+     * by a promotion are kept, the rest are picked out before any is
+     * freed, as freeing one may free the kept ones.
+     */
+    int n = 0;
+    for (int i = 0; i < lform.dead.count; ++i)
+    {
+        lval *v = lform.dead.items[i];
+        v->flags &= ~LVAL_DEAD;
+        if (v->ref == 0)
+            lform.dead.items[n++] = v;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        lval *v = lform.dead.items[i];
+        v->ref = 1;
+        lval_del(v);
+    }
+    lform.dead.count = 0;
+
+    double pause = lform_now() - start;
+    lform.stat.forms++;
+    lform.stat.pause_ns += pause;
+    if (pause > lform.stat.pause_max_ns)
+        lform.stat.pause_max_ns = pause;
+}
+
+/* Totals since the last call, which starts them afresh */
+void lval_region_stats(lform_stat *s)
+{
+    *s = lform.stat;
+    memset(&lform.stat, 0, sizeof(lform.stat));
+}
+
+/* Whether references to v are being counted right now */
+static int lval_counted(lval *v)
+{
+    return v->ref != LVAL_IMMORTAL && (!lform.active || (v->flags & LVAL_REGION));
+}
+
+/* New block with room for cap cells, region ones go with their form */
+static lcells *lcells_new(int cap, int region)
+{
+    size_t size = sizeof(lcells) + sizeof(lval *) * cap;
+    lcells *b;
+    if (region)
+    {
+        b = lregion_alloc(lform.mem, size);
+        b->flags = LVAL_REGION;
+    }
+    else
+    {
+        b = malloc(size);
+        b->flags = 0;
+    }
+    b->ref = 1;
+    b->lo = 0;
+    b->hi = 0;
+    b->cap = cap;
+    return b;
+}
+
+/* Another list views cells of b, region lists only borrow heap blocks */
+static lcells *lcells_ref(lcells *b)
+{
+    if (b && (!lform.active || (b->flags & LVAL_REGION)))
+        b->ref++;
+    return b;
+}
+
+/* Drop a list's reference to b, the last one deletes the cells it holds */
+static void lcells_del(lcells *b)
+{
+    if (!b || (lform.active && !(b->flags & LVAL_REGION)))
+        return;
+    if (--b->ref > 0 || (b->flags & LVAL_REGION))
+        return;
+
+    for (int i = b->lo; i < b->hi; ++i)
+        lval_del(b->slot[i]);
+    free(b);
+}
+
+/* Whether values stored into e must be promoted to the heap */
+static int lenv_is_heap(lenv *e)
+{
+    return lform.active && !(e->flags & LVAL_REGION);
+}
+
 /****************
  * Constructors
  ****************/
+static lenv *lenv_alloc(int region)
+{
+    lenv *e;
+    if (region)
+    {
+        e = lregion_alloc(lform.mem, sizeof(lenv));
+        e->flags = LVAL_REGION;
+        lptrs_push(&lform.envs, e);
+    }
+    else
+    {
+        e = lalloc(sizeof(lenv));
+        e->flags = 0;
+    }
+    return e;
+}
+
 lenv *lenv_new(void)
 {
-    lenv *e = (lenv *)malloc(sizeof(lenv));
+    lenv *e = lenv_alloc(lform.active);
     e->par = NULL;
+    e->ref = 1;
+    e->fwd = NULL;
     e->count = 0;
     e->syms = NULL;
     e->vals = NULL;
+    e->cap = 0;
+    e->index = NULL;
     return e;
 }
 
-lval *lval_new(void)
+/* Bytes needed by a lval of the given type, only its payload is allocated */
+size_t lval_size(int type)
+{
+    switch (type)
+    {
+    case LVAL_NUM:
+    case LVAL_INT:
+    case LVAL_ERR:
+    case LVAL_SYM:
+        return offsetof(lval, num) + sizeof(double);
+    case LVAL_BIG:
+        return offsetof(lval, big) + sizeof(lbig *);
+    case LVAL_VEC:
+        return offsetof(lval, vec) + sizeof(lvec *);
+    case LVAL_MEMO:
+        return offsetof(lval, memo) + sizeof(lmemo *);
+    case LVAL_FUNC:
+        return offsetof(lval, code) + sizeof(lcode *);
+    case LVAL_PART:
+        return offsetof(lval, bound) + sizeof(lval *);
+    default:
+        return offsetof(lval, compiled) + sizeof(lcode *);
+    }
+}
+
+static lval *lval_alloc(int type, int region)
 {
-    lval *n = malloc(sizeof(lval));
-    n->builtin = NULL;
-    n = lval_set_name(n, "");
+    lval *n;
+    if (region)
+    {
+        n = lregion_alloc(lform.mem, lval_size(type));
+        n->flags = LVAL_REGION;
+        if (type == LVAL_ERR || type == LVAL_BIG || type == LVAL_VEC || type == LVAL_FUNC || type == LVAL_MEMO)
+            lptrs_push(&lform.vals, n);
+    }
+    else
+    {
+        n = lalloc(lval_size(type));
+        n->flags = 0;
+    }
+    n->type = type;
+    n->ref = 1;
     return n;
 }
 
+lval *lval_new(int type)
+{
+    return lval_alloc(type, lform.active);
+}
+
+/* Numbers in this range are preallocated and shared */
+#define LVAL_SMALL_MIN -128
+#define LVAL_SMALL_MAX 1023
+
+static lval lval_small[LVAL_SMALL_MAX - LVAL_SMALL_MIN + 1];
+static lval lval_small_int[LVAL_SMALL_MAX - LVAL_SMALL_MIN + 1];
+
 /* Construct a pointer to a new Number lval */
 lval *lval_num(double x)
 {
-    lval *v = lval_new();
-    v->type = LVAL_NUM;
-    v->count = 0;
+    /* Small integers never allocate, -0.0 is not one of them */
+    if (x >= LVAL_SMALL_MIN && x <= LVAL_SMALL_MAX && x == (int)x && !(x == 0 && signbit(x)))
+    {
+        lval *v = &lval_small[(int)x - LVAL_SMALL_MIN];
+        if (v->ref == 0)
+        {
+            v->type = LVAL_NUM;
+            v->ref = LVAL_IMMORTAL;
+            v->num = x;
+        }
+        return v;
+    }
+
+    lval *v = lval_new(LVAL_NUM);
     v->num = x;
     return v;
 }
 
+/* Construct a pointer to a new Integer lval */
+lval *lval_int(int64_t x)
+{
+    if (x >= LVAL_SMALL_MIN && x <= LVAL_SMALL_MAX)
+    {
+        lval *v = &lval_small_int[x - LVAL_SMALL_MIN];
+        if (v->ref == 0)
+        {
+            v->type = LVAL_INT;
+            v->ref = LVAL_IMMORTAL;
+            v->inum = x;
+        }
+        return v;
+    }
+
+    lval *v = lval_new(LVAL_INT);
+    v->inum = x;
+    return v;
+}
+
+/* Construct a pointer to an Integer lval taking b, which stays big only if it has to */
+lval *lval_big(lbig *b)
+{
+    int64_t x;
+    if (lbig_to_int(b, &x))
+    {
+        lbig_del(b);
+        return lval_int(x);
+    }
+
+    lval *v = lval_new(LVAL_BIG);
+    v->big = b;
+    return v;
+}
+
+/* Construct a pointer to a new Vector lval taking x */
+lval *lval_vec(lvec *x)
+{
+    lval *v = lval_new(LVAL_VEC);
+    v->vec = x;
+    return v;
+}
+
 /* Construct a pointer to a new Error lval */
 lval *lval_err(char *fmt, ...)
 {
-    lval *v = lval_new();
-    v->type = LVAL_ERR;
+    lval *v = lval_new(LVAL_ERR);
 
     /* Create a va list and initialize it */
     va_list va;
@@ -102,182 +578,901 @@ lval *lval_err(char *fmt, ...)
 /* Construct a pointer to a new Symbol lval */
 lval *lval_sym(char *s)
 {
-    lval *v = lval_new();
-    v->type = LVAL_SYM;
-    v->sym = malloc(strlen(s) + 1);
-    v->count = 0;
-    strcpy(v->sym, s);
+    lval *v = lval_new(LVAL_SYM);
+    v->sym = lsym_intern(s);
     return v;
 }
 
 /* Construct a pointer to a new empty Sexpr lval */
 lval *lval_sexpr(void)
 {
-    lval *v = lval_new();
-    v->type = LVAL_SEXPR;
+    lval *v = lval_new(LVAL_SEXPR);
     v->count = 0;
+    v->blk = NULL;
     v->cell = NULL;
+    v->compiled = NULL;
     return v;
 }
 
 /* Construct a pointer to a new empty Qexpr lval */
 lval *lval_qexpr(void)
 {
-    lval *v = lval_new();
-    v->type = LVAL_QEXPR;
+    lval *v = lval_new(LVAL_QEXPR);
     v->count = 0;
+    v->blk = NULL;
     v->cell = NULL;
+    v->compiled = NULL;
     return v;
 }
 
 /* Construct a pointer to a new empty Built-In Func lval */
 lval *lval_func(lbuiltin func)
 {
-    lval *v = lval_new();
-    v->type = LVAL_FUNC;
+    lval *v = lval_new(LVAL_FUNC);
     v->builtin = func;
+    v->name = lsym_intern("");
+    v->code = NULL;
     return v;
 }
 
-lval *lval_lambda(lval *formals, lval *body)
+/* Construct a closure over env e */
+lval *lval_lambda(lenv *e, lval *formals, lval *body)
 {
-    lval *v = lval_new();
-    v->type = LVAL_FUNC;
+    lval *v = lval_new(LVAL_FUNC);
 
     /* Set builtin to NULL */
     v->builtin = NULL;
 
-    /* Build new environment */
-    v->env = lenv_new();
+    /* Capture the defining environment, calls run in a child of it, see lenv_drop */
+    v->env = lenv_ref(e);
 
-    /* Set Formals and Body */
+    /* Set Formals and Body, the body is compiled on first call */
     v->formals = formals;
     v->body = body;
+    v->code = NULL;
 
     return v;
 }
 
-/**************
- * Destructor
- **************/
-
-/* Delete a lval */
-void lval_del(lval *v)
+/* Construct a partial application of lambda fn to the argument list bound, taking both */
+lval *lval_part(lval *fn, lval *bound)
 {
-    if (!v)
-        return;
+    lval *v = lval_new(LVAL_PART);
+    v->fn = fn;
+    v->bound = bound;
+    return v;
+}
 
-    switch (v->type)
-    {
-    /* Do nothing special for number type */
-    case LVAL_NUM:
-        break;
+/****************
+ * Collection
+ ****************/
 
-    /* For Err or Sym free the string data */
-    case LVAL_ERR:
-        free(v->err);
-        break;
-    case LVAL_SYM:
-        free(v->sym);
-        break;
+/*
+ * With --gc the region of a form is a nursery collected at safe points
+ * as well as dropped at the end of the form, so a long running form
+ * keeps a bounded footprint. A minor collection copies what the roots
+ * reach into a fresh region and resets the old one:
+ *
+ *  - Roots are the VM stack and frames, and the locals of the tree
+ *    walker pushed with lgc_push.
+ *  - Safe points are calls of lambdas in the VM and tail calls in the
+ *    walker. Builtins and memos keep region values in C locals, so the
+ *    region is pinned while they run.
+ *  - Heap values are never copied. Survivors stay in the region, they
+ *    are moved to the heap, the old generation, only when stored into
+ *    a heap env as in plain region mode.
+ *  - Reference counts are copied as they are. They may overstate what
+ *    refers to a survivor, which only costs a copy in lval_mut.
+ */
 
-    case LVAL_FUNC:
-        if (!v->builtin)
-        {
-            lenv_del(v->env);
-            lval_del(v->formals);
-            lval_del(v->body);
-        }
-        break;
+/* Region bytes allocated between collections at the least */
+#ifndef LGC_NURSERY
+#define LGC_NURSERY (1 << 20)
+#endif
 
-    /* If Sexpr then delete all elements inside */
-    case LVAL_SEXPR:
-    case LVAL_QEXPR:
-        for (int i = 0; i < v->count; i++)
-        {
-            lval_del(v->cell[i]);
-        }
-        /* Also free the memory allocated to contain the pointers */
-        free(v->cell);
-        break;
-    }
+lgc_roots lgc;
 
-    free(v->name);
+/* State of a collection, copies of region objects map to themselves */
+static struct
+{
+    void **from;
+    void **to;
+    int count;
+    int cap;
 
-    /* Free the memory allocated to the lval v itself */
-    free(v);
+    /* Copies whose fields still point into the old region, tagged with their kind */
+    lptrs work;
 
-    return;
-}
+    /* Region and lists of the next collection */
+    lregion *spare;
+    lptrs vals;
+    lptrs envs;
 
-void lenv_del(lenv *env)
+    /* Region bytes at which the next collection is due */
+    size_t next;
+} lgc_state;
+
+#define LGC_VAL 0
+#define LGC_ENV 1
+#define LGC_BLK 2
+
+void lgc_grow(void)
 {
-    for (int i = 0; i < env->count; ++i)
-    {
-        free(env->syms[i]);
-        lval_del(env->vals[i]);
-    }
-    free(env->syms);
-    free(env->vals);
-    free(env);
+    lgc.cap = lgc.cap ? lgc.cap * 2 : 256;
+    lgc.slots = realloc(lgc.slots, sizeof(uintptr_t) * lgc.cap);
 }
 
-/**************
- *  Modifier
- **************/
+static void lgc_reset(void)
+{
+    lgc_state.next = LGC_NURSERY;
+}
 
-lenv *lenv_copy(lenv *e)
+static unsigned lgc_hash(void *p)
 {
-    lenv *n = lenv_new();
+    return (unsigned)(((uintptr_t)p >> 3) * 0x9e3779b97f4a7c15ULL >> 32);
+}
 
-    n->par = e->par;
-    n->count = e->count;
-    n->syms = malloc(sizeof(char *) * n->count);
-    n->vals = malloc(sizeof(lval *) * n->count);
-    for (int i = 0; i < e->count; ++i)
-    {
-        n->syms[i] = malloc(strlen(e->syms[i]) + 1);
-        strcpy(n->syms[i], e->syms[i]);
-        n->vals[i] = lval_copy(e->vals[i]);
-    }
+/* Copy of region object p, NULL if it has none yet */
+static void *lgc_find(void *p)
+{
+    if (!lgc_state.cap)
+        return NULL;
+    unsigned mask = lgc_state.cap - 1;
+    for (unsigned h = lgc_hash(p) & mask; lgc_state.from[h]; h = (h + 1) & mask)
+        if (lgc_state.from[h] == p)
+            return lgc_state.to[h];
+    return NULL;
+}
 
-    return n;
+static void lgc_map(void *p, void *x)
+{
+    unsigned mask = lgc_state.cap - 1;
+    unsigned h = lgc_hash(p) & mask;
+    while (lgc_state.from[h])
+        h = (h + 1) & mask;
+    lgc_state.from[h] = p;
+    lgc_state.to[h] = x;
+    lgc_state.count++;
 }
 
-/* Using key to get lval from environment */
-lval *lenv_get_value(lenv *e, lval *k)
+/* Record x as the copy of p, and as its own */
+static void lgc_forward(void *p, void *x, int kind)
 {
-    /* Iterate overall items in env */
-    for (int i = 0; i < e->count; ++i)
-    {
-        /* Check if stored string matches the symbol string */
-        if (strcmp(e->syms[i], k->sym) == 0)
-            return lval_copy(e->vals[i]);
-    }
-    /* If no symbol, check in parent env otherwise error */
-    if (e->par)
+    if ((lgc_state.count + 2) * 2 > lgc_state.cap)
     {
-        return lenv_get_value(e->par, k);
+        void **from = lgc_state.from, **to = lgc_state.to;
+        int cap = lgc_state.cap;
+        lgc_state.cap = cap ? cap * 2 : 1024;
+        lgc_state.from = calloc(lgc_state.cap, sizeof(void *));
+        lgc_state.to = malloc(sizeof(void *) * lgc_state.cap);
+        lgc_state.count = 0;
+        for (int i = 0; i < cap; ++i)
+            if (from[i])
+                lgc_map(from[i], to[i]);
+        free(from);
+        free(to);
     }
-    else
-        return lval_err("Unbound symbol: %s!", k->sym);
+    lgc_map(p, x);
+    lgc_map(x, x);
+    lptrs_push(&lgc_state.work, (char *)x + kind);
 }
 
-/* Using function pointer to get its name from environment */
-lval *lenv_get_key(lenv *e, lbuiltin f)
+static lval *lgc_val(lval *v)
 {
-    lval *res = NULL;
-    if (!e)
-        return lval_err("No such environment!");
-    /* Iterate overall items in env */
+    if (!v || !(v->flags & LVAL_REGION))
+        return v;
+    lval *x = lgc_find(v);
+    if (x)
+        return x;
+
+    x = lval_alloc(v->type, 1);
+    memcpy(x, v, lval_size(v->type));
+    lgc_forward(v, x, LGC_VAL);
+    return x;
+}
+
+static lenv *lgc_env(lenv *e)
+{
+    if (!e || !(e->flags & LVAL_REGION))
+        return e;
+    lenv *x = lgc_find(e);
+    if (x)
+        return x;
+
+    x = lenv_alloc(1);
+    *x = *e;
+    lgc_forward(e, x, LGC_ENV);
+    return x;
+}
+
+/* Blocks keep their capacity, as lists view them at offsets */
+static lcells *lgc_blk(lcells *b)
+{
+    if (!b || !(b->flags & LVAL_REGION))
+        return b;
+    lcells *x = lgc_find(b);
+    if (x)
+        return x;
+
+    x = lcells_new(b->cap, 1);
+    *x = *b;
+    memcpy(x->slot + b->lo, b->slot + b->lo, sizeof(lval *) * (b->hi - b->lo));
+    lgc_forward(b, x, LGC_BLK);
+    return x;
+}
+
+/* Point the fields of copy x at copies of what they refer to */
+static void lgc_scan_val(lval *x)
+{
+    switch (x->type)
+    {
+    case LVAL_FUNC:
+        if (!x->builtin)
+        {
+            x->env = lgc_env(x->env);
+            x->formals = lgc_val(x->formals);
+            x->body = lgc_val(x->body);
+        }
+        break;
+    case LVAL_PART:
+        x->fn = lgc_val(x->fn);
+        x->bound = lgc_val(x->bound);
+        break;
+    case LVAL_MEMO:
+    {
+        /* Entries keyed by a moved function stop matching, a memo is only a cache */
+        lmemo *m = x->memo;
+        x->memo = lmemo_copy(m, lgc_val);
+        lmemo_del(m, 0);
+        break;
+    }
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+        if (x->blk)
+        {
+            lcells *b = lgc_blk(x->blk);
+            x->cell = b->slot + (x->cell - x->blk->slot);
+            x->blk = b;
+        }
+        break;
+    }
+}
+
+static void lgc_scan(void)
+{
+    while (lgc_state.work.count)
+    {
+        char *p = lgc_state.work.items[--lgc_state.work.count];
+        int kind = (uintptr_t)p & 3;
+        p -= kind;
+
+        if (kind == LGC_VAL)
+            lgc_scan_val((lval *)p);
+        else if (kind == LGC_ENV)
+        {
+            lenv *x = (lenv *)p;
+            x->par = lgc_env(x->par);
+            for (int i = 0; i < x->count; ++i)
+                x->vals[i] = lgc_val(x->vals[i]);
+        }
+        else
+        {
+            lcells *x = (lcells *)p;
+            for (int i = x->lo; i < x->hi; ++i)
+                x->slot[i] = lgc_val(x->slot[i]);
+        }
+    }
+}
+
+static void lgc_move_val(lval **v)
+{
+    *v = lgc_val(*v);
+}
+
+static void lgc_move_env(lenv **e)
+{
+    *e = lgc_env(*e);
+}
+
+/* Minor collection, copy what the roots reach out of the region of the form */
+static void lgc_collect(void)
+{
+    double start = lform_now();
+    lregion *from = lform.mem;
+    lptrs vals = lform.vals;
+    lptrs envs = lform.envs;
+    lform.mem = lgc_state.spare ? lgc_state.spare : lregion_new();
+    lform.vals = lgc_state.vals;
+    lform.envs = lgc_state.envs;
+
+    for (int i = 0; i < lgc.count; ++i)
+    {
+        if (lgc.slots[i] & 1)
+            lgc_move_env((lenv **)(lgc.slots[i] - 1));
+        else
+            lgc_move_val((lval **)lgc.slots[i]);
+    }
+    lvm_roots(lgc_move_val, lgc_move_env);
+    lgc_scan();
+
+    /* What was not copied goes with the old region, along with the memory it owns */
+    for (int i = 0; i < vals.count; ++i)
+        if (!lgc_find(vals.items[i]))
+            lform_free_val(vals.items[i]);
+    for (int i = 0; i < envs.count; ++i)
+        if (!lgc_find(envs.items[i]))
+            lform_free_env(envs.items[i]);
+    vals.count = 0;
+    envs.count = 0;
+    lgc_state.vals = vals;
+    lgc_state.envs = envs;
+
+    size_t used = lregion_used(from);
+    lform.stat.bytes += used;
+    if (used > lform.stat.peak)
+        lform.stat.peak = used;
+    lregion_reset(from);
+    lgc_state.spare = from;
+
+    /* Clearing the forwarding table costs its size, keep it near what survives */
+    if (lgc_state.count * 8 < lgc_state.cap)
+    {
+        free(lgc_state.from);
+        free(lgc_state.to);
+        lgc_state.from = lgc_state.to = NULL;
+        lgc_state.cap = 0;
+    }
+    else if (lgc_state.count)
+        memset(lgc_state.from, 0, sizeof(void *) * lgc_state.cap);
+    lgc_state.count = 0;
+
+    /* Collect again once the nursery has grown by twice what survived */
+    size_t live = lregion_used(lform.mem);
+    lgc_state.next = live + (2 * live > LGC_NURSERY ? 2 * live : LGC_NURSERY);
+
+    double pause = lform_now() - start;
+    lform.stat.collections++;
+    lform.stat.copied += live;
+    lform.stat.gc_ns += pause;
+    if (pause > lform.stat.gc_max_ns)
+        lform.stat.gc_max_ns = pause;
+}
+
+/* Reached where the roots hold every region value in use */
+void lgc_safepoint(void)
+{
+    if (lform.active && lregion_used(lform.mem) >= lgc_state.next)
+        lgc_collect();
+}
+
+/**************
+ * Destructor
+ **************/
+
+/* Drop a reference to a lval, deleting it with the last one */
+void lval_del(lval *v)
+{
+    if (!v || v->ref == LVAL_IMMORTAL)
+        return;
+
+    /* Region values go with their form, heap values are only borrowed */
+    if (lform.active)
+    {
+        if (v->flags & LVAL_REGION)
+            v->ref--;
+        return;
+    }
+
+    if (--v->ref > 0)
+        return;
+
+    switch (v->type)
+    {
+    /* Do nothing special for number types */
+    case LVAL_NUM:
+    case LVAL_INT:
+        break;
+    case LVAL_BIG:
+        lbig_del(v->big);
+        break;
+    case LVAL_VEC:
+        lvec_del(v->vec);
+        break;
+
+    /* For Err free the string data, symbols are interned */
+    case LVAL_ERR:
+        free(v->err);
+        break;
+    case LVAL_FUNC:
+        if (!v->builtin)
+        {
+            lenv_del(v->env);
+            lval_del(v->formals);
+            lval_del(v->body);
+            lcode_del(v->code);
+            lopt_forget(v);
+        }
+        break;
+    case LVAL_PART:
+        lval_del(v->fn);
+        lval_del(v->bound);
+        break;
+    case LVAL_MEMO:
+        lmemo_del(v->memo, 1);
+        break;
+
+    /* If Sexpr then its block deletes the elements with its last list */
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+        lcells_del(v->blk);
+        lcode_del(v->compiled);
+        break;
+    }
+
+    /* Free the memory allocated to the lval v itself */
+    lfree(v, lval_size(v->type));
+
+    return;
+}
+
+/* Drop a reference held by an env, which may be a long-lived one */
+void lval_release(lval *v)
+{
+    if (!lform.active || (v->flags & LVAL_REGION))
+    {
+        lval_del(v);
+        return;
+    }
+
+    /* Temporaries may still borrow it, free it after the form */
+    if (v->ref != LVAL_IMMORTAL && --v->ref == 0 && !(v->flags & LVAL_DEAD))
+    {
+        v->flags |= LVAL_DEAD;
+        lptrs_push(&lform.dead, v);
+    }
+}
+
+/* Drop a reference to an env, deleting it and releasing its parent with the last one */
+void lenv_del(lenv *env)
+{
+    /* Envs are only borrowed during a form, region ones go with it */
+    if (!env || lform.active)
+        return;
+
+    if (--env->ref > 0)
+        return;
+
+    for (int i = 0; i < env->count; ++i)
+        lval_del(env->vals[i]);
+    free(env->syms);
+    free(env->vals);
+    free(env->index);
+    lenv_del(env->par);
+    lfree(env, sizeof(lenv));
+}
+
+/* Most values, blocks and envs lenv_drop follows from a frame before it gives up */
+#define LREACH_MAX 4096
+
+enum
+{
+    LREACH_VAL,
+    LREACH_CELLS,
+    LREACH_ENV
+};
+
+/* Something reached from a frame's bindings, with the references found to it */
+typedef struct lreach
+{
+    void *p;
+    int kind;
+    int in;  /* references held by what was reached */
+    int out; /* held from outside as well */
+} lreach;
+
+/* Graph reached from the frame being dropped, node 0 is the frame */
+static struct
+{
+    lenv *frame;
+    lreach *nodes;
+    int count;
+    int cap;
+    int *index; /* positions in nodes by address, -1 when free */
+    int icap;
+    int *stack;
+    int sp;
+    int full;
+} lr;
+
+static unsigned lreach_hash(void *p)
+{
+    uintptr_t h = (uintptr_t)p >> 3;
+    return (unsigned)(h ^ (h >> 17)) * 2654435761u;
+}
+
+/* Position of p in the index, or of the free slot it would take */
+static int lreach_slot(void *p)
+{
+    unsigned mask = lr.icap - 1;
+    unsigned h = lreach_hash(p) & mask;
+    while (lr.index[h] != -1 && lr.nodes[lr.index[h]].p != p)
+        h = (h + 1) & mask;
+    return h;
+}
+
+/* Node of p, added and queued for a visit the first time it is reached */
+static lreach *lreach_node(void *p, int kind)
+{
+    if (lr.count * 2 >= lr.icap)
+    {
+        lr.icap = lr.icap ? lr.icap * 2 : 64;
+        lr.index = realloc(lr.index, sizeof(int) * lr.icap);
+        memset(lr.index, -1, sizeof(int) * lr.icap);
+        for (int i = 0; i < lr.count; ++i)
+            lr.index[lreach_slot(lr.nodes[i].p)] = i;
+    }
+
+    int h = lreach_slot(p);
+    if (lr.index[h] != -1)
+        return &lr.nodes[lr.index[h]];
+
+    if (lr.count == lr.cap)
+    {
+        lr.cap = lr.cap ? lr.cap * 2 : 64;
+        lr.nodes = realloc(lr.nodes, sizeof(lreach) * lr.cap);
+        lr.stack = realloc(lr.stack, sizeof(int) * lr.cap);
+    }
+    lr.index[h] = lr.count;
+    lr.nodes[lr.count] = (lreach){p, kind, 0, 0};
+    lr.stack[lr.sp++] = lr.count;
+    return &lr.nodes[lr.count++];
+}
+
+/* Whether env e is the frame or a frame of a call made below it */
+static int lreach_below(lenv *e)
+{
+    for (; e; e = e->par)
+        if (e == lr.frame)
+            return 1;
+    return 0;
+}
+
+/*
+ * Reference from a reached node to p. Only what may hold the frame is
+ * followed: lists, partial applications, lambdas and envs below the
+ * frame. Leaving out a reference only keeps the frame alive.
+ */
+static void lreach_edge(void *p, int kind, int mark)
+{
+    if (!p || lr.full)
+        return;
+
+    if (kind == LREACH_VAL)
+    {
+        lval *v = p;
+        if (v->ref == LVAL_IMMORTAL)
+            return;
+        if (v->type == LVAL_FUNC ? v->builtin != NULL
+                                 : v->type != LVAL_PART && v->type != LVAL_SEXPR && v->type != LVAL_QEXPR)
+            return;
+    }
+    else if (kind == LREACH_ENV && !lreach_below(p))
+        return;
+
+    if (!mark && lr.count >= LREACH_MAX)
+    {
+        lr.full = 1;
+        return;
+    }
+
+    lreach *n = lreach_node(p, kind);
+    if (!mark)
+        n->in++;
+    else if (!n->out)
+    {
+        n->out = 1;
+        lr.stack[lr.sp++] = n - lr.nodes;
+    }
+}
+
+/* Follow the references node n holds, counting them or marking what they reach as held */
+static void lreach_visit(lreach *n, int mark)
+{
+    switch (n->kind)
+    {
+    case LREACH_ENV:
+    {
+        lenv *e = n->p;
+        for (int i = 0; i < e->count; ++i)
+            lreach_edge(e->vals[i], LREACH_VAL, mark);
+        if (e != lr.frame)
+            lreach_edge(e->par, LREACH_ENV, mark);
+        break;
+    }
+    case LREACH_CELLS:
+    {
+        lcells *b = n->p;
+        for (int i = b->lo; i < b->hi; ++i)
+            lreach_edge(b->slot[i], LREACH_VAL, mark);
+        break;
+    }
+    default:
+    {
+        lval *v = n->p;
+        if (v->type == LVAL_FUNC)
+        {
+            lreach_edge(v->env, LREACH_ENV, mark);
+            lreach_edge(v->formals, LREACH_VAL, mark);
+            lreach_edge(v->body, LREACH_VAL, mark);
+        }
+        else if (v->type == LVAL_PART)
+        {
+            lreach_edge(v->fn, LREACH_VAL, mark);
+            lreach_edge(v->bound, LREACH_VAL, mark);
+        }
+        else
+            lreach_edge(v->blk, LREACH_CELLS, mark);
+        break;
+    }
+    }
+}
+
+static int lreach_ref(lreach *n)
+{
+    switch (n->kind)
+    {
+    case LREACH_ENV:
+        return ((lenv *)n->p)->ref;
+    case LREACH_CELLS:
+        return ((lcells *)n->p)->ref;
+    default:
+        return ((lval *)n->p)->ref;
+    }
+}
+
+/*
+ * Whether only the call holds frame env once what is reachable solely
+ * from its bindings is set aside. Every list, partial application,
+ * closure and env below the frame reached from its bindings is counted
+ * the references it gets from the others. Those with more are held from
+ * outside, as is everything they reach, and the frame must be among the
+ * rest, with the call's reference left over.
+ */
+static int lreach_dead(lenv *env)
+{
+    lr.frame = env;
+    lr.count = 0;
+    lr.sp = 0;
+    lr.full = 0;
+    if (lr.icap)
+        memset(lr.index, -1, sizeof(int) * lr.icap);
+
+    lreach_node(env, LREACH_ENV);
+    while (lr.sp && !lr.full)
+        lreach_visit(&lr.nodes[lr.stack[--lr.sp]], 0);
+    if (lr.full)
+        return 0;
+
+    /* The call's own reference to the frame is not one from outside */
+    lr.nodes[0].in++;
+    for (int i = 0; i < lr.count; ++i)
+    {
+        if (lreach_ref(&lr.nodes[i]) > lr.nodes[i].in)
+        {
+            lr.nodes[i].out = 1;
+            lr.stack[lr.sp++] = i;
+        }
+    }
+    while (lr.sp && !lr.nodes[0].out)
+        lreach_visit(&lr.nodes[lr.stack[--lr.sp]], 1);
+    return !lr.nodes[0].out;
+}
+
+/* Drop the bindings of the frame and of the envs below it that nothing outside reaches */
+static void lreach_drop(void)
+{
+    /* Detach all the bindings first, deleting them frees the nodes */
+    int n = 0;
+    for (int i = 0; i < lr.count; ++i)
+        if (lr.nodes[i].kind == LREACH_ENV && !lr.nodes[i].out)
+            lr.stack[n++] = i;
+
+    lval ***vals = malloc(sizeof(lval **) * n);
+    int *counts = malloc(sizeof(int) * n);
+    for (int i = 0; i < n; ++i)
+    {
+        lenv *e = lr.nodes[lr.stack[i]].p;
+        vals[i] = e->vals;
+        counts[i] = e->count;
+        e->vals = NULL;
+        e->count = 0;
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = 0; j < counts[i]; ++j)
+            lval_del(vals[i][j]);
+        free(vals[i]);
+    }
+    free(vals);
+    free(counts);
+}
+
+/*
+ * Drop the reference of the call that ran in frame env. Closures the
+ * call stored in its frame, such as a local helper bound with '=', or a
+ * list or partial application holding one, keep the frame alive as it
+ * keeps them. Once nothing outside the frame reaches it, the bindings of
+ * the frame and of the frames below it that were reached are dropped,
+ * which breaks the cycle. Arguments are bound before any closure over
+ * the frame exists, so only frames that gained bindings later are
+ * looked at. Freeing a frame releases its parent, which is looked at in
+ * turn, as a call to a local helper leaves its caller's frame this way.
+ */
+void lenv_drop(lenv *env)
+{
+    if (!env || lform.active)
+        return;
+
+    for (;;)
+    {
+        if ((env->flags & LENV_EXTENDED) && env->ref > 1 && lreach_dead(env))
+            lreach_drop();
+
+        lenv *par = env->par;
+        if (env->ref > 1 || !par || !par->par)
+        {
+            lenv_del(env);
+            return;
+        }
+
+        /* Hold the parent as the call held env */
+        par->ref++;
+        lenv_del(env);
+        env = par;
+    }
+}
+
+/**************
+ *  Modifier
+ **************/
+
+/* Share env e, frames and closures hold envs by reference */
+lenv *lenv_ref(lenv *e)
+{
+    if (!lform.active)
+        e->ref++;
+    return e;
+}
+
+/* Copy a region env, its values and parents into the heap */
+lenv *lenv_promote(lenv *e)
+{
+    /* Already on the heap, take a counted reference */
+    if (!(e->flags & LVAL_REGION))
+    {
+        e->ref++;
+        return e;
+    }
+
+    /* Closures over the same frame keep sharing one copy of it */
+    if (e->fwd)
+    {
+        e->fwd->ref++;
+        return e->fwd;
+    }
+
+    lenv *n = lenv_alloc(0);
+    n->flags |= e->flags & LENV_EXTENDED;
+    n->ref = 1;
+    n->fwd = NULL;
+    e->fwd = n;
+
+    n->par = e->par ? lenv_promote(e->par) : NULL;
+    n->count = e->count;
+    n->syms = malloc(sizeof(char *) * n->count);
+    n->vals = malloc(sizeof(lval *) * n->count);
+    for (int i = 0; i < e->count; ++i)
+    {
+        n->syms[i] = e->syms[i];
+        n->vals[i] = lval_promote(e->vals[i]);
+    }
+
+    n->cap = e->cap;
+    n->index = NULL;
+    if (e->index)
+    {
+        n->index = malloc(sizeof(int) * n->cap);
+        memcpy(n->index, e->index, sizeof(int) * n->cap);
+    }
+
+    return n;
+}
+
+/* Interned symbols are unique, so hash the address itself */
+static unsigned lenv_hash(char *s)
+{
+    uintptr_t p = (uintptr_t)s;
+    return (unsigned)((p ^ (p >> 16)) * 2654435761u);
+}
+
+/* Insert position i of env into its index, the index must have a free slot */
+static void lenv_index_insert(lenv *e, int i)
+{
+    unsigned mask = e->cap - 1;
+    unsigned h = lenv_hash(e->syms[i]) & mask;
+    while (e->index[h] != -1)
+        h = (h + 1) & mask;
+    e->index[h] = i;
+}
+
+/* Rebuild the index so that it stays at most half full */
+static void lenv_reindex(lenv *e)
+{
+    int cap = e->cap ? e->cap : 16;
+    while (cap < e->count * 2)
+        cap *= 2;
+
+    e->cap = cap;
+    e->index = realloc(e->index, sizeof(int) * cap);
+    memset(e->index, -1, sizeof(int) * cap);
+    for (int i = 0; i < e->count; ++i)
+        lenv_index_insert(e, i);
+}
+
+/**
+ * @brief Find the position of a symbol in this env only
+ *
+ * @param e The specific environment
+ * @param sym Interned symbol string
+ * @return Index into syms/vals, or -1 if not bound here
+ */
+int lenv_find(lenv *e, char *sym)
+{
+    /* Small envs, e.g. function frames, are cheaper to scan */
+    if (!e->index)
+    {
+        for (int i = 0; i < e->count; ++i)
+            if (e->syms[i] == sym)
+                return i;
+        return -1;
+    }
+
+    unsigned mask = e->cap - 1;
+    for (unsigned h = lenv_hash(sym) & mask; e->index[h] != -1; h = (h + 1) & mask)
+    {
+        if (e->syms[e->index[h]] == sym)
+            return e->index[h];
+    }
+    return -1;
+}
+
+/* Using key to get lval from environment */
+lval *lenv_get_value(lenv *e, lval *k)
+{
+    /* Walk up the env chain until the symbol is found */
+    for (; e; e = e->par)
+    {
+        int i = lenv_find(e, k->sym);
+        if (i != -1)
+            return lval_copy(e->vals[i]);
+    }
+    return lval_err("Unbound symbol: %s!", k->sym);
+}
+
+/* Using function pointer to get its name from environment */
+lval *lenv_get_key(lenv *e, lbuiltin f)
+{
+    lval *res = NULL;
+    if (!e)
+        return lval_err("No such environment!");
+    /* Iterate overall items in env */
     for (int i = 0; i < e->count; ++i)
     {
         /* Check if stored pointer matches the func pointer */
-        if (e->vals[i]->builtin == f)
+        if (e->vals[i]->type == LVAL_FUNC && e->vals[i]->builtin == f)
         {
-            res = lval_copy(e->vals[i]);
-            res->sym = malloc(strlen(e->syms[i]) + 1);
-            strcpy(res->sym, e->syms[i]);
+            res = lval_set_name(lval_copy(e->vals[i]), e->syms[i]);
             return res;
         }
     }
@@ -300,16 +1495,31 @@ lval *lenv_get_key(lenv *e, lbuiltin f)
  */
 void lenv_put(lenv *e, lval *k, lval *v)
 {
-    /* Iterate overall items in env */
-    for (int i = 0; i < e->count; ++i)
+    /* If symbol already bound, replace its value */
+    int i = lenv_find(e, k->sym);
+    if (i != -1)
     {
-        /* Check if stored string matches the symbol string */
-        if (strcmp(e->syms[i], k->sym) == 0)
+        if (!e->par)
+            lopt_rebind(k->sym);
+        if (lenv_is_heap(e))
         {
+            lval_release(e->vals[i]);
+            e->vals[i] = lval_promote(v);
+        }
+        else
+        {
+            /* Region envs only borrow the heap values they hold */
             lval_del(e->vals[i]);
             e->vals[i] = lval_copy(v);
-            return;
         }
+        return;
+    }
+
+    /* A new name in a frame may shadow bindings resolved past it, compiled code checks the flag */
+    if (e->par && !(e->flags & LENV_BINDING))
+    {
+        e->flags |= LENV_EXTENDED;
+        lopt_rebind(k->sym);
     }
 
     /* If no symbol, allocate new space for it */
@@ -317,10 +1527,41 @@ void lenv_put(lenv *e, lval *k, lval *v)
     e->vals = realloc(e->vals, sizeof(lval *) * e->count);
     e->syms = realloc(e->syms, sizeof(char *) * e->count);
 
-    /* Copy contents of lval and symbol string into new location */
-    e->vals[e->count - 1] = lval_copy(v);
-    e->syms[e->count - 1] = malloc(strlen(k->sym) + 1);
-    strcpy(e->syms[e->count - 1], k->sym);
+    /* Copy contents of lval, the symbol string is shared */
+    e->vals[e->count - 1] = lenv_is_heap(e) ? lval_promote(v) : lval_copy(v);
+    e->syms[e->count - 1] = k->sym;
+
+    /* Keep the index at most half full */
+    if (e->index && e->count * 2 <= e->cap)
+        lenv_index_insert(e, e->count - 1);
+    else if (e->count >= LENV_INDEX_MIN)
+        lenv_reindex(e);
+}
+
+/**
+ * @brief Create a call frame below par with n bindings at fixed slots
+ *
+ * @param par Env the frame's lambda closes over
+ * @param syms Interned names of the slots, copied
+ * @param vals Values of the slots, their references are taken over
+ * @param n Number of slots, names must be distinct
+ */
+lenv *lenv_frame(lenv *par, char **syms, lval **vals, int n)
+{
+    lenv *e = lenv_new();
+    e->par = lenv_ref(par);
+    if (n == 0)
+        return e;
+
+    e->count = n;
+    e->syms = malloc(sizeof(char *) * n);
+    e->vals = malloc(sizeof(lval *) * n);
+    memcpy(e->syms, syms, sizeof(char *) * n);
+    memcpy(e->vals, vals, sizeof(lval *) * n);
+
+    if (n >= LENV_INDEX_MIN)
+        lenv_reindex(e);
+    return e;
 }
 
 /* Define value in the outmost env */
@@ -337,7 +1578,7 @@ void lenv_def(lenv *e, lval *k, lval *v)
 void lenv_add_builtin(lenv *e, char *name, lbuiltin func)
 {
     lval *k = lval_sym(name);
-    lval *v = lval_func(func);
+    lval *v = lval_set_name(lval_func(func), name);
     lenv_put(e, k, v);
     lval_del(k);
     lval_del(v);
@@ -355,12 +1596,25 @@ void lenv_add_builtins(lenv *e)
     lenv_add_builtin(e, "cons", builtin_cons);
     lenv_add_builtin(e, "len", builtin_len);
     lenv_add_builtin(e, "init", builtin_init);
+    lenv_add_builtin(e, "nth", builtin_nth);
+    lenv_add_builtin(e, "slice", builtin_slice);
 
     /* Mathematical Functions */
     lenv_add_builtin(e, "+", builtin_add);
     lenv_add_builtin(e, "-", builtin_sub);
     lenv_add_builtin(e, "*", builtin_mul);
     lenv_add_builtin(e, "/", builtin_div);
+    lenv_add_builtin(e, "%", builtin_mod);
+    lenv_add_builtin(e, "^", builtin_pow);
+
+    /* Comparison Functions */
+    lenv_add_builtin(e, "if", builtin_if);
+    lenv_add_builtin(e, "==", builtin_eq);
+    lenv_add_builtin(e, "!=", builtin_ne);
+    lenv_add_builtin(e, ">", builtin_gt);
+    lenv_add_builtin(e, "<", builtin_lt);
+    lenv_add_builtin(e, ">=", builtin_ge);
+    lenv_add_builtin(e, "<=", builtin_le);
 
     /* Variable Functions */
     lenv_add_builtin(e, "def", builtin_def);
@@ -372,84 +1626,320 @@ void lenv_add_builtins(lenv *e)
     /* Exit Function */
     lenv_add_builtin(e, "exit", builtin_exit);
 
+    /* Vector Functions */
+    lenv_add_builtin(e, "vec", builtin_vec);
+    lenv_add_builtin(e, "unvec", builtin_unvec);
+    lenv_add_builtin(e, "dot", builtin_dot);
+    lenv_add_builtin(e, "vsum", builtin_vsum);
+    lenv_add_builtin(e, "vprod", builtin_vprod);
+    lenv_add_builtin(e, "vmin", builtin_vmin);
+    lenv_add_builtin(e, "vmax", builtin_vmax);
+
+    /* Memo Functions */
+    lenv_add_builtin(e, "memo", builtin_memo);
+    lenv_add_builtin(e, "memo-stats", builtin_memo_stats);
+
     /* Print Functions */
     lenv_add_builtin(e, "penv", builtin_penv);
+    lenv_add_builtin(e, "mem", builtin_mem);
 
     return;
 }
 
-lval *lval_read_num(mpc_ast_t *t)
+lval *lval_read_num(char *s)
 {
+    /* Numbers without a fraction are exact integers */
     errno = 0;
-    double x = strtod(t->contents, NULL);
+    if (!strchr(s, '.'))
+    {
+        long long i = strtoll(s, NULL, 10);
+        return errno != ERANGE
+                   ? lval_int(i)
+                   : lval_big(lbig_from_str(s));
+    }
+
+    double x = strtod(s, NULL);
     return errno != ERANGE
                ? lval_num(x)
                : lval_err(LERR_STR[STR_TO_NUM]);
 }
 
-lval *lval_read(mpc_ast_t *t)
+/*
+ * Parser callbacks, each builds the lval of the text its parser matched
+ * so that a parse yields the values themselves rather than an AST.
+ */
+
+static mpc_val_t *lval_read_number(mpc_val_t *x)
+{
+    lval *v = lval_read_num(x);
+    free(x);
+    return v;
+}
+
+static mpc_val_t *lval_read_symbol(mpc_val_t *x)
+{
+    lval *v = lval_sym(x);
+    free(x);
+    return v;
+}
+
+/* The expressions of a list, in a new S-Expression */
+static mpc_val_t *lval_read_list(int n, mpc_val_t **xs)
+{
+    return lval_add_cells(lval_reserve(lval_sexpr(), n), (lval **)xs, n);
+}
+
+/* The list between a pair of brackets, which are dropped */
+static mpc_val_t *lval_read_sexpr(int n, mpc_val_t **xs)
+{
+    (void)n;
+    free(xs[0]);
+    free(xs[2]);
+    return xs[1];
+}
+
+static mpc_val_t *lval_read_qexpr(int n, mpc_val_t **xs)
+{
+    lval *v = lval_read_sexpr(n, xs);
+    v->type = LVAL_QEXPR;
+    return v;
+}
+
+static void lval_read_del(mpc_val_t *x)
 {
-    /* If Symbol or Number then return conversion to that type */
-    if (strstr(t->tag, "number"))
-        return lval_read_num(t);
-    if (strstr(t->tag, "symbol"))
-        return lval_sym(t->contents);
+    lval_del(x);
+}
 
-    /* If root (>) or sexpr or qexpr then create empty list */
-    lval *x = lval_new();
-    if (strcmp(t->tag, ">") == 0)
-        x = lval_sexpr();
-    if (strstr(t->tag, "sexpr"))
-        x = lval_sexpr();
-    if (strstr(t->tag, "qexpr"))
-        x = lval_qexpr();
+/*
+ * Lists share blocks of cells, see lcells. A list only changes the
+ * slots of its block while it is the only one viewing it, otherwise
+ * it takes free slots next to its ends or moves into a block of its own.
+ */
+
+/* New list of type t viewing n cells of v from its ith on */
+static lval *lval_view(lval *v, int t, int i, int n)
+{
+    lval *x = lval_new(t);
+    x->count = n;
+    x->blk = n ? lcells_ref(v->blk) : NULL;
+    x->cell = n ? v->cell + i : NULL;
+    x->compiled = NULL;
+    return x;
+}
 
-    /* Fill this list with any valid expression contained within */
-    for (int i = 0; i < t->children_num; i++)
+/* List whose count and ends may be changed, v itself unless it is shared */
+static lval *lval_list_own(lval *v)
+{
+    if (v->ref == 1 && lval_counted(v))
     {
-        if (strcmp(t->children[i]->contents, "(") == 0)
-            continue;
-        if (strcmp(t->children[i]->contents, ")") == 0)
-            continue;
-        if (strcmp(t->children[i]->contents, "{") == 0)
-            continue;
-        if (strcmp(t->children[i]->contents, "}") == 0)
-            continue;
-        if (strcmp(t->children[i]->tag, "regex") == 0)
-            continue;
-        x = lval_add_tail(x, lval_read(t->children[i]));
+        /* Code compiled from the list no longer matches it */
+        lcode_del(v->compiled);
+        v->compiled = NULL;
+        return v;
     }
 
+    lval *x = lval_view(v, v->type, 0, v->count);
+    lval_del(v);
     return x;
 }
 
+/*
+ * Whether unshared list v may change its cells in place, which holds
+ * while no other list views its block. Slots outside v are released.
+ */
+static int lval_own_cells(lval *v)
+{
+    lcells *b = v->blk;
+    if (!b)
+        return 1;
+    if (b->ref != 1 || (b->flags & LVAL_REGION) != (v->flags & LVAL_REGION))
+        return 0;
+
+    int lo = v->cell - b->slot;
+    int hi = lo + v->count;
+    for (int i = b->lo; i < lo; ++i)
+        lval_del(b->slot[i]);
+    for (int i = hi; i < b->hi; ++i)
+        lval_del(b->slot[i]);
+    b->lo = lo;
+    b->hi = hi;
+    return 1;
+}
+
+/* Move the cells of unshared list v into block nb from slot i on */
+static void lval_rehome(lval *v, lcells *nb, int i)
+{
+    lcells *b = v->blk;
+    if (lval_own_cells(v))
+    {
+        if (v->count)
+            memcpy(&nb->slot[i], v->cell, sizeof(lval *) * v->count);
+        if (b)
+            b->hi = b->lo;
+    }
+    else
+    {
+        for (int j = 0; j < v->count; ++j)
+            nb->slot[i + j] = lval_copy(v->cell[j]);
+    }
+    lcells_del(b);
+
+    v->blk = nb;
+    v->cell = &nb->slot[i];
+    nb->lo = i;
+    nb->hi = i + v->count;
+}
+
+/* Whether block b may take cells of list v */
+static int lcells_fits(lcells *b, lval *v)
+{
+    return b && (b->flags & LVAL_REGION) == (v->flags & LVAL_REGION);
+}
+
+/* Give new list v a block of its own for n cells, which the caller fills */
+static void lval_cells_init(lval *v, int n)
+{
+    v->count = n;
+    v->blk = NULL;
+    v->cell = NULL;
+    v->compiled = NULL;
+    if (n)
+    {
+        v->blk = lcells_new(n, v->flags & LVAL_REGION);
+        v->blk->hi = n;
+        v->cell = v->blk->slot;
+    }
+}
+
+/* Make n slots after the cells of unshared list v free for it */
+static void lval_room_back(lval *v, int n)
+{
+    lcells *b = v->blk;
+    int own = 0;
+    if (lcells_fits(b, v))
+    {
+        int hi = v->cell - b->slot + v->count;
+        if (hi == b->hi && hi + n <= b->cap)
+            return;
+
+        /* A block of v's alone drops the slots past v, or slides v to its start */
+        own = lval_own_cells(v);
+        if (own && hi + n <= b->cap)
+            return;
+        if (own && v->count + n <= b->cap / 2)
+        {
+            memmove(b->slot, v->cell, sizeof(lval *) * v->count);
+            b->lo = 0;
+            b->hi = v->count;
+            v->cell = b->slot;
+            return;
+        }
+    }
+
+    /* A list outgrowing a block gets as much room again, so its next appends are cheap */
+    int cap = 4;
+    while (cap < v->count + n)
+        cap *= 2;
+    if (b && cap < 2 * (v->count + n))
+        cap *= 2;
+
+    /* A heap block of v's alone grows where it is */
+    if (own && !(b->flags & LVAL_REGION) && b->lo == 0)
+    {
+        b = realloc(b, sizeof(lcells) + sizeof(lval *) * cap);
+        b->cap = cap;
+        v->blk = b;
+        v->cell = b->slot;
+        return;
+    }
+    lval_rehome(v, lcells_new(cap, v->flags & LVAL_REGION), 0);
+}
+
+/* Make n slots before the cells of unshared list v free for it */
+static void lval_room_front(lval *v, int n)
+{
+    lcells *b = v->blk;
+    if (lcells_fits(b, v))
+    {
+        int lo = v->cell - b->slot;
+        if (lo == b->lo && lo >= n)
+            return;
+
+        /* A block of v's alone drops the slots before v */
+        if (lo >= n && lval_own_cells(v))
+            return;
+    }
+
+    /* As much room in front as there are cells, so conses stay cheap */
+    int gap = v->count + n > 4 ? v->count + n : 4;
+    lval_rehome(v, lcells_new(gap + v->count, v->flags & LVAL_REGION), gap);
+}
+
+/* Make room for n children in list v, returns the list to fill */
+lval *lval_reserve(lval *v, int n)
+{
+    v = lval_list_own(v);
+    if (n > v->count)
+        lval_room_back(v, n - v->count);
+    return v;
+}
+
+/* Append the n references xs to list v, returns the list holding them */
+lval *lval_add_cells(lval *v, lval **xs, int n)
+{
+    v = lval_list_own(v);
+    if (n == 0)
+        return v;
+
+    lval_room_back(v, n);
+    memcpy(&v->cell[v->count], xs, sizeof(lval *) * n);
+    v->count += n;
+    v->blk->hi += n;
+    return v;
+}
+
 lval *lval_add_tail(lval *v, lval *x)
 {
-    v->count++;
-    v->cell = realloc(v->cell, sizeof(lval *) * v->count);
-    v->cell[v->count - 1] = x;
+    v = lval_list_own(v);
+    lval_room_back(v, 1);
+    v->cell[v->count++] = x;
+    v->blk->hi++;
     return v;
 }
 
 lval *lval_add_head(lval *v, lval *x)
 {
+    v = lval_list_own(v);
+    lval_room_front(v, 1);
+
+    v->cell--;
+    v->blk->lo--;
     v->count++;
-    v->cell = realloc(v->cell, sizeof(lval *) * v->count);
-    lval **temp_array = malloc(sizeof(lval *) * (v->count - 1));
-    memmove(temp_array, v->cell, sizeof(lval *) * (v->count - 1));
-    memcpy(&(v->cell[1]), temp_array, sizeof(lval *) * (v->count - 1));
     v->cell[0] = x;
-
-    free(temp_array);
     return v;
 }
 
+/* List of n children of v from its ith on, sharing v's cells */
+lval *lval_slice(lval *v, int i, int n)
+{
+    lval *x = lval_view(v, v->type, i, n);
+    lval_del(v);
+    return x;
+}
+
+/* Values are immutable once shared, so a copy is another reference */
 lval *lval_copy(lval *v)
 {
-    lval *x = lval_new();
+    if (lval_counted(v))
+        v->ref++;
+    return v;
+}
+
+/* Make a private copy of v's node, children are shared */
+lval *lval_dup(lval *v)
+{
+    lval *x = lval_new(v->type);
 
-    x = lval_set_name(x, v->name);
-    x->type = v->type;
     switch (v->type)
     {
     /* Copy Functions and Numbers Directly */
@@ -457,32 +1947,49 @@ lval *lval_copy(lval *v)
         if (v->builtin)
         {
             x->builtin = v->builtin;
+            x->name = v->name;
+            x->code = NULL;
         }
         else
         {
             x->builtin = NULL;
-            x->env = lenv_copy(v->env);
+            x->env = lenv_ref(v->env);
             x->formals = lval_copy(v->formals);
             x->body = lval_copy(v->body);
+            x->code = lcode_copy(v->code);
         }
         break;
+    case LVAL_PART:
+        x->fn = lval_copy(v->fn);
+        x->bound = lval_copy(v->bound);
+        break;
+    case LVAL_MEMO:
+        x->memo = lmemo_copy(v->memo, lval_copy);
+        break;
     case LVAL_NUM:
         x->num = v->num;
         break;
-    /* Copy Strings use malloc and strcpy */
+    case LVAL_INT:
+        x->inum = v->inum;
+        break;
+    case LVAL_BIG:
+        x->big = lbig_copy(v->big);
+        break;
+    case LVAL_VEC:
+        x->vec = lvec_copy(v->vec);
+        break;
+    /* Copy Strings use malloc and strcpy, symbols are shared */
     case LVAL_ERR:
         x->err = (char *)malloc(strlen(v->err) + 1);
         strcpy(x->err, v->err);
         break;
     case LVAL_SYM:
-        x->sym = (char *)malloc(strlen(v->sym) + 1);
-        strcpy(x->sym, v->sym);
+        x->sym = v->sym;
         break;
-    /* Copy lists by coping each sub-expressions */
+    /* Copy lists by sharing each sub-expressions */
     case LVAL_QEXPR:
     case LVAL_SEXPR:
-        x->count = v->count;
-        x->cell = malloc(sizeof(lval *) * x->count);
+        lval_cells_init(x, v->count);
         for (int i = 0; i < x->count; ++i)
             x->cell[i] = lval_copy(v->cell[i]);
         break;
@@ -490,13 +1997,102 @@ lval *lval_copy(lval *v)
     return x;
 }
 
+/* Make v safe to modify in place, copying it if it is shared */
+lval *lval_mut(lval *v)
+{
+    if (v->ref == 1 && lval_counted(v) &&
+        ((v->type != LVAL_SEXPR && v->type != LVAL_QEXPR) || lval_own_cells(v)))
+    {
+        if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR)
+        {
+            lcode_del(v->compiled);
+            v->compiled = NULL;
+        }
+        return v;
+    }
+
+    lval *x = lval_dup(v);
+    lval_del(v);
+    return x;
+}
+
+/* Copy v out of the form region so that a long-lived env can keep it */
+lval *lval_promote(lval *v)
+{
+    /* Already on the heap, take a counted reference */
+    if (!(v->flags & LVAL_REGION))
+    {
+        if (v->ref != LVAL_IMMORTAL)
+            v->ref++;
+        return v;
+    }
+
+    lform.stat.promoted++;
+    lval *x = lval_alloc(v->type, 0);
+    switch (v->type)
+    {
+    case LVAL_NUM:
+        x->num = v->num;
+        break;
+    case LVAL_INT:
+        x->inum = v->inum;
+        break;
+    case LVAL_BIG:
+        x->big = lbig_copy(v->big);
+        break;
+    case LVAL_VEC:
+        x->vec = lvec_copy(v->vec);
+        break;
+    case LVAL_ERR:
+        x->err = malloc(strlen(v->err) + 1);
+        strcpy(x->err, v->err);
+        break;
+    case LVAL_SYM:
+        x->sym = v->sym;
+        break;
+    case LVAL_FUNC:
+        x->builtin = v->builtin;
+        if (v->builtin)
+        {
+            x->name = v->name;
+            x->code = NULL;
+        }
+        else
+        {
+            x->env = lenv_promote(v->env);
+            x->formals = lval_promote(v->formals);
+            x->body = lval_promote(v->body);
+            x->code = lcode_copy(v->code);
+        }
+        break;
+    case LVAL_PART:
+        x->fn = lval_promote(v->fn);
+        x->bound = lval_promote(v->bound);
+        break;
+    case LVAL_MEMO:
+        x->memo = lmemo_copy(v->memo, lval_promote);
+        break;
+    case LVAL_QEXPR:
+    case LVAL_SEXPR:
+        lval_cells_init(x, v->count);
+        for (int i = 0; i < x->count; ++i)
+            x->cell[i] = lval_promote(v->cell[i]);
+        break;
+    }
+    return x;
+}
+
 lval *lval_set_name(lval *v, char *name)
 {
-    LASSERT(v, v->type != LVAL_ERR || v->type != LVAL_SYM,
+    LASSERT(v, v->type == LVAL_FUNC && v->builtin,
             "func-%s, line-%d: Invalid type", __func__, __LINE__);
 
-    v->name = malloc(strlen(name) + 1);
-    strcpy(v->name, name);
+    name = lsym_intern(name);
+    if (v->name == name)
+        return v;
+
+    v = lval_mut(v);
+    v->name = name;
 
     return v;
 }
@@ -510,6 +2106,29 @@ void lval_print(lenv *e, lval *v)
     case LVAL_NUM:
         printf("%g", v->num);
         break;
+    case LVAL_INT:
+        printf("%lld", (long long)v->inum);
+        break;
+    case LVAL_BIG:
+    {
+        char *str = lbig_to_str(v->big);
+        printf("%s", str);
+        free(str);
+        break;
+    }
+    case LVAL_VEC:
+        putchar('[');
+        for (int i = 0; i < v->vec->count; ++i)
+        {
+            if (i)
+                putchar(' ');
+            if (v->vec->elem == LVEC_I64)
+                printf("%lld", (long long)v->vec->i64[i]);
+            else
+                printf("%g", v->vec->f64[i]);
+        }
+        putchar(']');
+        break;
     case LVAL_ERR:
         printf("Error: %s", v->err);
         break;
@@ -530,7 +2149,7 @@ void lval_print(lenv *e, lval *v)
             putchar(')');
         }
 
-        if (strcmp(v->name, "penv") == 0)
+        if (v->builtin && v->name == lsym_penv)
         {
             printf("\n    <name>  --    <type>\n");
             for (int i = 0; i < e->count; ++i)
@@ -540,6 +2159,24 @@ void lval_print(lenv *e, lval *v)
             printf("total: %d\n", e->count);
         }
         break;
+    case LVAL_PART:
+        /* Shown as a lambda of the formals still to be bound */
+        printf("(\\ {");
+        for (int i = v->bound->count; i < v->fn->formals->count; ++i)
+        {
+            lval_print(e, v->fn->formals->cell[i]);
+            if (i != v->fn->formals->count - 1)
+                putchar(' ');
+        }
+        printf("} ");
+        lval_print(e, v->fn->body);
+        putchar(')');
+        break;
+    case LVAL_MEMO:
+        printf("(memo ");
+        lval_print(e, lmemo_fn(v->memo));
+        putchar(')');
+        break;
     case LVAL_SEXPR:
         lval_expr_print(e, v, '(', ')');
         break;
@@ -574,61 +2211,125 @@ void lval_expr_print(lenv *e, lval *v, char open, char close)
     putchar(close);
 }
 
-char *readline(char *prompt)
+lval *lval_eval_sexpr(lenv *e, lval *v)
 {
-    fputs(prompt, stdout);
-    fgets(buffer, 2048, stdin);
-    char *cpy = malloc(strlen(buffer) + 1);
-    strcpy(cpy, buffer);
-    cpy[strlen(cpy) - 1] = '\0';
-    return cpy;
-}
+    /* Frame of the lambda whose body is being run by a tail call */
+    lenv *frame = NULL;
+    lval *f = NULL;
+    lval *result;
+
+    lgc_push_env(&e);
+    lgc_push_env(&frame);
+    lgc_push(&v);
+    lgc_push(&f);
+
+    /* Calls in tail position loop here instead of recursing */
+    for (;;)
+    {
+        lgc_poll();
+
+        /* Children are replaced by their values */
+        v = lval_mut(v);
+
+        /* Evaluate Children, the list may be moved meanwhile */
+        for (int i = 0; i < v->count; ++i)
+        {
+            lval *x = lval_eval(e, v->cell[i]);
+            v->cell[i] = x;
+        }
+
+        /* Error Checking */
+        int err = -1;
+        for (int i = 0; i < v->count && err == -1; ++i)
+            if (v->cell[i]->type == LVAL_ERR)
+                err = i;
+        if (err != -1)
+        {
+            result = lval_take(v, err);
+            break;
+        }
+
+        /* Empty Expression */
+        if (v->count == 0)
+        {
+            result = v;
+            break;
+        }
+        /* Single Expression */
+        if (v->count == 1)
+        {
+            result = lval_take(v, 0);
+            break;
+        }
+
+        /* Ensure First Element is Function after evaluation */
+        f = lval_pop(v, 0);
+        if (f->type != LVAL_FUNC && f->type != LVAL_PART && f->type != LVAL_MEMO)
+        {
+            lval_del(f);
+            lval_del(v);
+            result = lval_err(LERR_STR[SEXPR_NO_FUNC]);
+            break;
+        }
 
-lval *lval_eval_sexpr(lenv *e, lval *v)
-{
-    /* Evaluate Children */
-    for (int i = 0; i < v->count; ++i)
-        v->cell[i] = lval_eval(e, v->cell[i]);
+        if (f->type == LVAL_MEMO)
+        {
+            result = lmemo_call(e, f, v);
+            lval_del(f);
+            break;
+        }
 
-    /* Error Checking */
-    for (int i = 0; i < v->count; ++i)
-        if (v->cell[i]->type == LVAL_ERR)
-            return lval_take(v, i);
+        /* A partial application calls its lambda with all arguments so far */
+        if (f->type == LVAL_PART)
+        {
+            v = lval_join(lval_copy(f->bound), v);
+            lval *fn = lval_copy(f->fn);
+            lval_del(f);
+            f = fn;
+        }
 
-    /* Empty Expression */
-    if (v->count == 0)
-        return v;
-    /* Single Expression */
-    if (v->count == 1)
-        return lval_take(v, 0);
+        /* 'eval' and 'if' continue with the expression they pick */
+        if (f->builtin == builtin_eval || f->builtin == builtin_if)
+        {
+            v = f->builtin == builtin_eval ? lval_eval_arg(v) : lval_if_branch(v);
+            lval_del(f);
+            f = NULL;
+            if (v->type == LVAL_ERR)
+            {
+                result = v;
+                break;
+            }
+            continue;
+        }
 
-    /* Ensure First Element is Function after evaluation */
-    lval *f = lval_pop(v, 0);
-    if (f->type != LVAL_FUNC)
-    {
+        if (f->builtin || lvm_enabled)
+        {
+            /* Call function to get result */
+            result = lval_call(e, f, v);
+            lval_del(f);
+            break;
+        }
+
+        lenv *env;
+        result = lval_bind(f, v, &env);
+        if (result)
+        {
+            lval_del(f);
+            break;
+        }
+
+        /* Run the body in place of the lambda being run, if any */
+        lenv_drop(frame);
+        frame = env;
+        e = env;
+        v = lval_mut(lval_copy(lopt_body(f)));
+        v->type = LVAL_SEXPR;
         lval_del(f);
-        lval_del(v);
-        return lval_err(LERR_STR[SEXPR_NO_FUNC]);
-    }
-
-    /* Call function to get result */
-    lval *result = lval_call(e, f, v);
-    // lval *symbol = lenv_get_key(e, f->builtin);
-    // if (symbol->type == LVAL_SYM)
-    // {
-    //     result->sym = malloc(strlen(symbol->sym) + 1);
-    //     strcpy(result->sym, symbol->sym);
-    // }
-    // else
-    // {
-    //     result->sym = malloc(512);
-    //     char *temp = "not-builtin\0";
-    //     strcpy(result->sym, temp);
-    //     result->sym = realloc(result->sym, strlen(temp) + 1);
-    // }
-
-    // lval_del(symbol);
-    lval_del(f);
+        f = NULL;
+    }
+
+    lgc_pop(4);
+    lenv_drop(frame);
     return result;
 }
 
@@ -637,7 +2338,10 @@ lval *lval_eval(lenv *e, lval *v)
     if (v->type == LVAL_SYM)
     {
         lval *x = lenv_get_value(e, v);
-        x = lval_set_name(x, v->sym);
+
+        /* Builtins are printed by the name they were looked up with */
+        if (x->type == LVAL_FUNC && x->builtin)
+            x = lval_set_name(x, v->sym);
 
         lval_del(v);
         return x;
@@ -652,107 +2356,164 @@ lval *lval_eval(lenv *e, lval *v)
 
 lval *lval_call(lenv *e, lval *f, lval *a)
 {
-    /* If builtin then simply call that */
+    /* Memos and partial applications, which memos may wrap, call what they hold */
+    if (f->type == LVAL_MEMO)
+        return lmemo_call(e, f, a);
+    if (f->type == LVAL_PART)
+    {
+        a = lval_join(lval_copy(f->bound), a);
+        f = f->fn;
+    }
+
+    /* If builtin then simply call that, the region stays put meanwhile */
+    lval *r;
     if (f->builtin)
-        return f->builtin(e, a);
+    {
+        lgc_pin();
+        r = f->builtin(e, a);
+        lgc_unpin();
+        return r;
+    }
+
+    /* Bind arguments, a partial application or error is returned as is */
+    lenv *env;
+    r = lval_bind(f, a, &env);
+    if (r)
+        return r;
+
+    /* Run the compiled body if possible, otherwise evaluate it */
+    lgc_push_env(&env);
+    if (lvm_enabled)
+        r = lvm_exec(f, env);
+    else
+        r = builtin_eval(env, lval_add_tail(lval_sexpr(), lval_copy(lopt_body(f))));
+    lgc_pop(1);
+
+    lenv_drop(env);
+    return r;
+}
 
+/**
+ * @brief Bind arguments a to the formals of lambda f in a new frame
+ *
+ * @param f Lambda, left unchanged
+ * @param a Arguments, deleted
+ * @param frame Set to the frame, a child of the env f closes over, once
+ *        all formals are bound
+ * @return NULL once all formals are bound, otherwise a partial application
+ *         of f holding the arguments, or an error
+ */
+lval *lval_bind(lval *f, lval *a, lenv **frame)
+{
     /* Record Argument Counts */
+    lval *formals = f->formals;
     int given = a->count;
-    int total = f->formals->count;
+    int total = formals->count;
+
+    /* Until the formals before '&' are all given, only the arguments are kept */
+    int required = 0;
+    while (required < total && formals->cell[required]->sym != lsym_amp)
+        required++;
+    if (given < required)
+        return lval_part(lval_copy(f), a);
+
+    lenv *env = lenv_new();
+    env->par = lenv_ref(f->env);
+    env->flags |= LENV_BINDING;
+
+    /* Formals bound so far, and arguments. The arguments are read in place, a
+       partial application's may share cells with the list it keeps */
+    int i = 0;
+    int j = 0;
 
     /* While arguments still remain to be processed */
-    while (a->count)
+    while (j < a->count)
     {
         /* If we have run out of formal arguments to bind */
-        if (f->formals->count == 0)
+        if (i == total)
         {
             lval_del(a);
+            lenv_del(env);
             return lval_err("Function passed too many arguments. "
                             "Got %i, Expected %i.",
                             given, total);
         }
 
-        /* Bind corresponding formals and args into the func's env */
-        lval *sym = lval_pop(f->formals, 0);
+        /* Bind corresponding formals and args into the frame */
+        lval *sym = formals->cell[i++];
         /* Special case to deal with '&' */
-        if (strcmp(sym->sym, "&") == 0)
+        if (sym->sym == lsym_amp)
         {
             /* Ensure '&' is followed by another symbol */
-            if (f->formals->count != 1)
+            if (total - i != 1)
             {
                 lval_del(a);
+                lenv_del(env);
                 return lval_err("Function format invalid. "
                                 "Symbol '&' not followed by single symbol.");
             }
 
             /* Next formal should be bound to remaining arguments */
-            lval *nsym = lval_pop(f->formals, 0);
-            lenv_put(f->env, nsym, builtin_list(e, a));
-            lval_del(sym);
-            lval_del(nsym);
+            lval *nsym = formals->cell[i++];
+            lval *rest = builtin_list(env, lval_slice(a, j, a->count - j));
+            lenv_put(env, nsym, rest);
+            lval_del(rest);
+            a = NULL;
             break;
         }
-        lval *val = lval_pop(a, 0);
-        lenv_put(f->env, sym, val);
-
-        lval_del(sym);
-        lval_del(val);
+        lenv_put(env, sym, a->cell[j++]);
     }
 
     /* Arguments have been all bound, so delete the arg list */
     lval_del(a);
 
     /* If '&' remains in formal list bind to empty list */
-    if (f->formals->count > 0 &&
-        strcmp(f->formals->cell[0]->sym, "&") == 0)
+    if (i < total && formals->cell[i]->sym == lsym_amp)
     {
         /* Check to ensure that & is not passed invalidly. */
-        if (f->formals->count != 2)
+        if (total - i != 2)
         {
+            lenv_del(env);
             return lval_err("Function format invalid. "
                             "Symbol '&' not followed by single symbol.");
         }
-        /* Pop and delete the '&' symbol */
-        lval_del(lval_pop(f->formals, 0));
-        /* Pop next symbol and create empty list */
-        lval *sym = lval_pop(f->formals, 0);
+        /* Bind the symbol after '&' to an empty list */
         lval *val = lval_qexpr();
-        /* Bind environment and delete */
-        lenv_put(f->env, sym, val);
-        lval_del(sym);
+        lenv_put(env, formals->cell[i + 1], val);
         lval_del(val);
+        i += 2;
     }
 
-    /* If all formals have been bound evaluate */
-    if ((f->formals->count == 0))
-    {
-        f->env->par = e;
+    /* Bindings from now on are added by the body */
+    env->flags &= ~LENV_BINDING;
 
-        /* Evaluate and return */
-        return builtin_eval(f->env, lval_add_tail(lval_sexpr(), lval_copy(f->body)));
-    }
-    else
-    {
-        /* Otherwise return partially evaluated func */
-        return lval_copy(f);
-    }
+    /* All formals have been bound, the body can be evaluated */
+    *frame = env;
+    return NULL;
 }
 
-/* Pop out the first child of list v */
+/* Pop out the ith child of list v, neither v nor its cells may be shared */
 lval *lval_pop(lval *v, int i)
 {
     /* Find the item[i] */
     lval *x = v->cell[i];
 
-    /* Move the children remained */
-    memmove(&v->cell[i], &v->cell[i + 1], sizeof(lval *) * (v->count - i - 1));
+    /* Close the gap from the shorter side, the front one leaves a free slot */
+    if (i < v->count / 2)
+    {
+        memmove(&v->cell[1], &v->cell[0], sizeof(lval *) * i);
+        v->cell++;
+        v->blk->lo++;
+    }
+    else
+    {
+        memmove(&v->cell[i], &v->cell[i + 1], sizeof(lval *) * (v->count - i - 1));
+        v->blk->hi--;
+    }
 
     /* Decrease the count of items in the list */
     v->count--;
 
-    /* Reallocate the memory used */
-    v->cell = realloc(v->cell, sizeof(lval *) * v->count);
-
     return x;
 }
 
@@ -765,12 +2526,25 @@ lval *lval_take(lval *v, int i)
     return x;
 }
 
+/* Append y to x, the cells of x are shared when free slots follow them */
 lval *lval_join(lval *x, lval *y)
 {
-    /* For each cell in 'y', add it to 'x' */
-    while (y->count)
+    x = lval_list_own(x);
+
+    /* Move the cells of an unshared 'y' over, copy those of a shared one */
+    if (y->ref == 1 && lval_counted(y) && lval_own_cells(y))
+    {
+        x = lval_add_cells(x, y->cell, y->count);
+        if (y->blk)
+            y->blk->hi = y->blk->lo;
+        y->count = 0;
+    }
+    else if (y->count)
     {
-        x = lval_add_tail(x, lval_pop(y, 0));
+        lval_room_back(x, y->count);
+        for (int i = 0; i < y->count; ++i)
+            x->cell[x->count++] = lval_copy(y->cell[i]);
+        x->blk->hi += y->count;
     }
 
     /* Delete the empty 'y' and return 'x' */
@@ -778,19 +2552,32 @@ lval *lval_join(lval *x, lval *y)
     return x;
 }
 
+/* Status the interpreter exits with once exit was evaluated */
+int lispy_exit_status = 0;
+
 lval *builtin_exit(lenv *e, lval *a)
 {
     LASSERT(a, a->count == 1, "Function 'exit' has no argument!");
 
+    /* An integer argument is the exit status */
+    lispy_exit_status = a->cell[0]->type == LVAL_INT ? (int)a->cell[0]->inum : 0;
+
     /* Delete lval a */
     lval_del(a);
 
-    /* Delete the environment */
+    /* Delete the environment, leaving it empty but usable */
+    lopt_version++;
     for (int i = 0; i < e->count; ++i)
     {
-        lval_del(e->vals[i]);
-        free(e->syms[i]);
+        if (lenv_is_heap(e))
+            lval_release(e->vals[i]);
+        else
+            lval_del(e->vals[i]);
     }
+    e->count = 0;
+    free(e->index);
+    e->index = NULL;
+    e->cap = 0;
 
     return lval_sym("exit");
 }
@@ -802,6 +2589,36 @@ lval *builtin_penv(lenv *e, lval *a)
     return lval_sym("penv");
 }
 
+static void print_alloc_stats(lalloc_stat *stats, int n)
+{
+    printf("    <size>    <allocs>     <frees>    <slabs>\n");
+    for (int i = 0; i < n; ++i)
+    {
+        if (stats[i].allocs == 0)
+            continue;
+        printf("%10zu  %10zu  %10zu  %9zu\n",
+               stats[i].size, stats[i].allocs, stats[i].frees, stats[i].slabs);
+    }
+}
+
+lval *builtin_mem(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1, "Function 'mem' has no argument!");
+    lval_del(a);
+    lalloc_stats(print_alloc_stats);
+    if (lform.active)
+        printf("region: %zu bytes\n", lregion_used(lform.mem));
+    if (lform.stat.forms)
+        printf("regions: %zu forms, %zu bytes, %zu promoted, pause avg %.1f us, max %.1f us\n",
+               lform.stat.forms, lform.stat.bytes, lform.stat.promoted,
+               lform.stat.pause_ns / lform.stat.forms / 1e3, lform.stat.pause_max_ns / 1e3);
+    if (lform.stat.collections)
+        printf("collections: %zu, %zu bytes copied, pause avg %.1f us, max %.1f us\n",
+               lform.stat.collections, lform.stat.copied,
+               lform.stat.gc_ns / lform.stat.collections / 1e3, lform.stat.gc_max_ns / 1e3);
+    return lval_sexpr();
+}
+
 /**
  * @brief Define global functions
  *
@@ -839,7 +2656,7 @@ lval *builtin_lambda(lenv *e, lval *a)
     lval *body = lval_pop(a, 0);
     lval_del(a);
 
-    return lval_lambda(formals, body);
+    return lval_lambda(e, formals, body);
 }
 
 lval *builtin_var(lenv *e, lval *a, char *func)
@@ -876,107 +2693,689 @@ lval *builtin_var(lenv *e, lval *a, char *func)
     }
 
     lval_del(a);
-    return lval_sexpr();
+    return lval_sexpr();
+}
+
+/* Element i of x as a double */
+static double lvec_elem(lvec *x, int i)
+{
+    return x->elem == LVEC_I64 ? (double)x->i64[i] : x->f64[i];
+}
+
+/* Whether v is an int64 vector or an int64 scalar */
+static int lval_is_i64(lval *v)
+{
+    return v->type == LVAL_INT || (v->type == LVAL_VEC && v->vec->elem == LVEC_I64);
+}
+
+/*
+ * x op y element by element, where at least one of them is a vector and
+ * the other may be a number broadcast to every element. Division by a
+ * zero element is an error, as it is for numbers. Int64 results that
+ * overflow are computed in double instead, so unlike numbers, which
+ * become big integers, the whole result is then inexact. If reuse is
+ * set x is an unshared double vector whose elements may be overwritten.
+ */
+static lval *lvec_apply(LVEC_OP op, lval *x, lval *y, int reuse)
+{
+    int xs = x->type == LVAL_VEC;
+    int ys = y->type == LVAL_VEC;
+    int n = xs ? x->vec->count : y->vec->count;
+    int cmp = op >= LVEC_LT;
+
+    if (xs && ys && x->vec->count != y->vec->count)
+        return lval_err("Vectors of different lengths %i and %i.", x->vec->count, y->vec->count);
+
+    if (lval_is_i64(x) && lval_is_i64(y) && op != LVEC_DIV)
+    {
+        const int64_t *xp = xs ? x->vec->i64 : &x->inum;
+        const int64_t *yp = ys ? y->vec->i64 : &y->inum;
+        lvec *r = lvec_new(LVEC_I64, n);
+        if (cmp)
+        {
+            lvec_i64_cmp(op, r->i64, xp, xs, yp, ys, n);
+            return lval_vec(r);
+        }
+        if (!lvec_i64_arith(op, r->i64, xp, xs, yp, ys, n))
+            return lval_vec(r);
+        lvec_del(r);
+    }
+
+    /* Anything else runs on doubles, int64 vectors are converted first */
+    lvec *xt = NULL;
+    lvec *yt = NULL;
+    double xd = xs ? 0 : LVAL_AS_DOUBLE(x);
+    double yd = ys ? 0 : LVAL_AS_DOUBLE(y);
+    const double *xp = !xs ? &xd : x->vec->elem == LVEC_F64 ? x->vec->f64 : (xt = lvec_to_f64(x->vec))->f64;
+    const double *yp = !ys ? &yd : y->vec->elem == LVEC_F64 ? y->vec->f64 : (yt = lvec_to_f64(y->vec))->f64;
+
+    if (op == LVEC_DIV)
+    {
+        for (int i = 0; i < (ys ? n : 1); ++i)
+        {
+            if (yp[i] == 0)
+            {
+                lvec_del(xt);
+                lvec_del(yt);
+                return lval_err(LERR_STR[DIV_BY_ZERO]);
+            }
+        }
+    }
+
+    lval *res;
+    if (cmp)
+    {
+        lvec *r = lvec_new(LVEC_I64, n);
+        lvec_f64_cmp(op, r->i64, xp, xs, yp, ys, n);
+        res = lval_vec(r);
+    }
+    else if (reuse && xs && x->vec->elem == LVEC_F64)
+    {
+        lvec_f64_arith(op, x->vec->f64, xp, xs, yp, ys, n);
+        res = lval_copy(x);
+    }
+    else
+    {
+        lvec *r = lvec_new(LVEC_F64, n);
+        lvec_f64_arith(op, r->f64, xp, xs, yp, ys, n);
+        res = lval_vec(r);
+    }
+
+    lvec_del(xt);
+    lvec_del(yt);
+    return res;
+}
+
+/* builtin_op when some argument is a vector, % and ^ are not element-wise */
+static lval *lop_vec(lval *v, LOP op)
+{
+    if (op == LOP_MOD || op == LOP_POW)
+    {
+        lval_del(v);
+        return lval_err(LERR_STR[BAD_OP]);
+    }
+    LVEC_OP vop = op == LOP_ADD ? LVEC_ADD : op == LOP_SUB ? LVEC_SUB : op == LOP_MUL ? LVEC_MUL : LVEC_DIV;
+
+    /* If no arguments and sub then perform unary negation */
+    if (op == LOP_SUB && v->count == 1)
+    {
+        lval *x = lvec_apply(vop, lval_int(0), v->cell[0], 0);
+        lval_del(v);
+        return x;
+    }
+
+    /*
+     * Results are folded into a fresh vector, which later steps may
+     * overwrite. So may the first step if v holds the only reference.
+     */
+    lval *x = v->cell[0];
+    int reuse = x->ref == 1 && lval_counted(x);
+    x = lval_copy(x);
+    for (int i = 1; i < v->count && x->type != LVAL_ERR; ++i)
+    {
+        lval *r = lvec_apply(vop, x, v->cell[i], reuse);
+        lval_del(x);
+        x = r;
+        reuse = x->ref == 1 && lval_counted(x);
+    }
+
+    lval_del(v);
+    return x;
+}
+
+/*
+ * Arithmetic kernels, one per (operator, operand type). A kernel folds
+ * y into the accumulator x and returns an error, or NULL on success.
+ * Exact kernels leave x unchanged and return lop_overflow when the
+ * result needs a wider integer, or lop_inexact when it is not an
+ * integer at all; the fold then goes on as big integer or double.
+ */
+typedef lval *(*lop_num_kernel)(double *x, double y);
+typedef lval *(*lop_int_kernel)(int64_t *x, int64_t y);
+typedef lval *(*lop_big_kernel)(lbig **x, lbig *y);
+
+static lval lop_overflow;
+static lval lop_inexact;
+
+#define LOP_NUM_KERNEL(name, expr)                         \
+    static lval *lop_num_##name(double *x, double y)       \
+    {                                                      \
+        expr;                                              \
+        return NULL;                                       \
+    }
+
+LOP_NUM_KERNEL(add, *x += y)
+LOP_NUM_KERNEL(sub, *x -= y)
+LOP_NUM_KERNEL(mul, *x *= y)
+LOP_NUM_KERNEL(div, if (y == 0) return lval_err(LERR_STR[DIV_BY_ZERO]); *x /= y)
+LOP_NUM_KERNEL(mod,
+               if (*x != trunc(*x) || y != trunc(y) ||
+                   fabs(*x) >= 0x1p63 || fabs(y) >= 0x1p63)
+                   return lval_err(LERR_STR[MOD_ON_FLT_AND_OVFLW]);
+               if (y == 0) return lval_err(LERR_STR[DIV_BY_ZERO]);
+               *x = y == -1 ? 0 : (double)((int64_t)*x % (int64_t)y))
+LOP_NUM_KERNEL(pow,
+               if (*x < 0) return lval_err(LERR_STR[POW_ON_NEG]);
+               *x = (*x == 0 && y == 0) ? 1 : pow(*x, y))
+
+#undef LOP_NUM_KERNEL
+
+#define LOP_INT_KERNEL(name, expr)                         \
+    static lval *lop_int_##name(int64_t *x, int64_t y)     \
+    {                                                      \
+        expr;                                              \
+        return NULL;                                       \
+    }
+
+LOP_INT_KERNEL(add, int64_t r; if (lint_add(*x, y, &r)) return &lop_overflow; *x = r)
+LOP_INT_KERNEL(sub, int64_t r; if (lint_sub(*x, y, &r)) return &lop_overflow; *x = r)
+LOP_INT_KERNEL(mul, int64_t r; if (lint_mul(*x, y, &r)) return &lop_overflow; *x = r)
+LOP_INT_KERNEL(div,
+               if (y == 0) return lval_err(LERR_STR[DIV_BY_ZERO]);
+               if (y == -1 && *x == INT64_MIN) return &lop_overflow;
+               if (*x % y != 0) return &lop_inexact;
+               *x /= y)
+LOP_INT_KERNEL(mod,
+               if (y == 0) return lval_err(LERR_STR[DIV_BY_ZERO]);
+               *x = y == -1 ? 0 : *x % y)
+
+#undef LOP_INT_KERNEL
+
+/* Square and multiply, a zero power is 1 as in the double kernel */
+static lval *lop_int_pow(int64_t *x, int64_t y)
+{
+    if (*x < 0)
+        return lval_err(LERR_STR[POW_ON_NEG]);
+    if (y < 0)
+        return &lop_inexact;
+
+    int64_t r = 1;
+    int64_t b = *x;
+    for (; y; y >>= 1)
+    {
+        if ((y & 1) && lint_mul(r, b, &r))
+            return &lop_overflow;
+        if ((y >> 1) && lint_mul(b, b, &b))
+            return &lop_overflow;
+    }
+    *x = r;
+    return NULL;
+}
+
+#define LOP_BIG_KERNEL(name, expr)                         \
+    static lval *lop_big_##name(lbig **x, lbig *y)         \
+    {                                                      \
+        lbig *r = NULL;                                    \
+        expr;                                              \
+        lbig_del(*x);                                      \
+        *x = r;                                            \
+        return NULL;                                       \
+    }
+
+LOP_BIG_KERNEL(add, r = lbig_add(*x, y))
+LOP_BIG_KERNEL(sub, r = lbig_sub(*x, y))
+LOP_BIG_KERNEL(mul, r = lbig_mul(*x, y))
+LOP_BIG_KERNEL(div,
+               lbig *m;
+               if (lbig_divmod(*x, y, &r, &m) < 0) return lval_err(LERR_STR[DIV_BY_ZERO]);
+               int exact = m->len == 0;
+               lbig_del(m);
+               if (!exact) { lbig_del(r); return &lop_inexact; })
+LOP_BIG_KERNEL(mod,
+               if (lbig_divmod(*x, y, NULL, &r) < 0) return lval_err(LERR_STR[DIV_BY_ZERO]))
+
+#undef LOP_BIG_KERNEL
+
+/* Big powers are refused past LBIG_POW_MAX_BITS and computed in double */
+static lval *lop_big_pow(lbig **x, lbig *y)
+{
+    int64_t n;
+    if ((*x)->neg)
+        return lval_err(LERR_STR[POW_ON_NEG]);
+    if (y->neg || !lbig_to_int(y, &n))
+        return &lop_inexact;
+
+    lbig *r = lbig_pow(*x, (uint64_t)n);
+    if (!r)
+        return &lop_inexact;
+    lbig_del(*x);
+    *x = r;
+    return NULL;
+}
+
+static const lop_num_kernel lop_num_kernels[LOP_NUM] = {
+    [LOP_ADD] = lop_num_add,
+    [LOP_SUB] = lop_num_sub,
+    [LOP_MUL] = lop_num_mul,
+    [LOP_DIV] = lop_num_div,
+    [LOP_MOD] = lop_num_mod,
+    [LOP_POW] = lop_num_pow,
+};
+
+static const lop_int_kernel lop_int_kernels[LOP_NUM] = {
+    [LOP_ADD] = lop_int_add,
+    [LOP_SUB] = lop_int_sub,
+    [LOP_MUL] = lop_int_mul,
+    [LOP_DIV] = lop_int_div,
+    [LOP_MOD] = lop_int_mod,
+    [LOP_POW] = lop_int_pow,
+};
+
+static const lop_big_kernel lop_big_kernels[LOP_NUM] = {
+    [LOP_ADD] = lop_big_add,
+    [LOP_SUB] = lop_big_sub,
+    [LOP_MUL] = lop_big_mul,
+    [LOP_DIV] = lop_big_div,
+    [LOP_MOD] = lop_big_mod,
+    [LOP_POW] = lop_big_pow,
+};
+
+/* Argument lists of doubles at least this long are reduced with SIMD */
+#define LOP_SIMD_MIN 16
+
+/*
+ * Sum or product of the doubles in cells, in one pass with several
+ * accumulators. The additions are reassociated, so the last bits may
+ * differ from a left fold.
+ */
+static double lop_reduce(lval **cells, int n, LOP op)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    __m128d a0 = _mm_set1_pd(op == LOP_ADD ? 0.0 : 1.0);
+    __m128d a1 = a0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128d x0 = _mm_set_pd(cells[i + 1]->num, cells[i]->num);
+        __m128d x1 = _mm_set_pd(cells[i + 3]->num, cells[i + 2]->num);
+        if (op == LOP_ADD)
+        {
+            a0 = _mm_add_pd(a0, x0);
+            a1 = _mm_add_pd(a1, x1);
+        }
+        else
+        {
+            a0 = _mm_mul_pd(a0, x0);
+            a1 = _mm_mul_pd(a1, x1);
+        }
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, op == LOP_ADD ? _mm_add_pd(a0, a1) : _mm_mul_pd(a0, a1));
+    double r = op == LOP_ADD ? lanes[0] + lanes[1] : lanes[0] * lanes[1];
+#else
+    double acc[4];
+    for (int k = 0; k < 4; ++k)
+        acc[k] = op == LOP_ADD ? 0.0 : 1.0;
+    for (; i + 4 <= n; i += 4)
+    {
+        for (int k = 0; k < 4; ++k)
+        {
+            if (op == LOP_ADD)
+                acc[k] += cells[i + k]->num;
+            else
+                acc[k] *= cells[i + k]->num;
+        }
+    }
+    double r = op == LOP_ADD ? (acc[0] + acc[1]) + (acc[2] + acc[3])
+                             : (acc[0] * acc[1]) * (acc[2] * acc[3]);
+#endif
+
+    for (; i < n; ++i)
+    {
+        if (op == LOP_ADD)
+            r += cells[i]->num;
+        else
+            r *= cells[i]->num;
+    }
+    return r;
+}
+
+lval *builtin_op(lenv *e, lval *v, LOP op)
+{
+    /* Ensure all arguments are numbers or vectors */
+    int doubles = 0;
+    int vecs = 0;
+    for (int i = 0; i < v->count; ++i)
+    {
+        if (!LVAL_IS_NUM(v->cell[i]) && v->cell[i]->type != LVAL_VEC)
+        {
+            lval_del(v);
+            return lval_err(LERR_STR[OP_ON_NAN]);
+        }
+        doubles += v->cell[i]->type == LVAL_NUM;
+        vecs += v->cell[i]->type == LVAL_VEC;
+    }
+
+    if (vecs)
+        return lop_vec(v, op);
+
+    /* Long sums and products of doubles are reduced in one pass */
+    if ((op == LOP_ADD || op == LOP_MUL) && doubles == v->count && v->count >= LOP_SIMD_MIN)
+    {
+        double num = lop_reduce(v->cell, v->count, op);
+        lval_del(v);
+        return lval_num(num);
+    }
+
+    /*
+     * The fold runs in int64 while results fit, then in big integers,
+     * and in double from the first double operand or inexact result.
+     */
+    lval *x = NULL;
+    lval *first = v->cell[0];
+    int i = 1;
+    int64_t inum = 0;
+    lbig *big = NULL;
+    double num;
+
+    /* If no arguments and sub then perform unary negation */
+    if (op == LOP_SUB && v->count == 1)
+    {
+        if (first->type == LVAL_INT && first->inum != INT64_MIN)
+            x = lval_int(-first->inum);
+        else if (first->type == LVAL_NUM)
+            x = lval_num(-first->num);
+        else
+        {
+            lbig *zero = lbig_from_int(0);
+            big = first->type == LVAL_INT ? lbig_from_int(first->inum) : first->big;
+            x = lval_big(lbig_sub(zero, big));
+            if (first->type == LVAL_INT)
+                lbig_del(big);
+            lbig_del(zero);
+        }
+        lval_del(v);
+        return x;
+    }
+
+    if (first->type == LVAL_INT)
+    {
+        inum = first->inum;
+        lop_int_kernel kernel = lop_int_kernels[op];
+        for (; i < v->count && v->cell[i]->type == LVAL_INT; ++i)
+        {
+            x = kernel(&inum, v->cell[i]->inum);
+            if (x)
+                break;
+        }
+
+        if (!x && i == v->count)
+        {
+            lval_del(v);
+            return lval_int(inum);
+        }
+        if (x == &lop_overflow || (!x && v->cell[i]->type == LVAL_BIG))
+            big = lbig_from_int(inum);
+    }
+    else if (first->type == LVAL_BIG)
+        big = lbig_copy(first->big);
+
+    if (big)
+    {
+        x = NULL;
+        lop_big_kernel kernel = lop_big_kernels[op];
+        for (; i < v->count && LVAL_IS_EXACT(v->cell[i]); ++i)
+        {
+            lval *y = v->cell[i];
+            lbig *ybig = y->type == LVAL_INT ? lbig_from_int(y->inum) : y->big;
+            x = kernel(&big, ybig);
+            if (y->type == LVAL_INT)
+                lbig_del(ybig);
+            if (x)
+                break;
+        }
+
+        if (!x && i == v->count)
+        {
+            lval_del(v);
+            return lval_big(big);
+        }
+    }
+
+    if (x && x != &lop_overflow && x != &lop_inexact)
+    {
+        lbig_del(big);
+        lval_del(v);
+        return x;
+    }
+
+    /* Go on in double from the first argument that did not fit */
+    x = NULL;
+    if (big)
+        num = lbig_to_double(big);
+    else if (first->type == LVAL_INT)
+        num = (double)inum;
+    else
+        num = first->num;
+    lbig_del(big);
+
+    /* Fold the remaining arguments in with the operator's kernel */
+    lop_num_kernel kernel = lop_num_kernels[op];
+    for (; i < v->count && !x; ++i)
+        x = kernel(&num, LVAL_AS_DOUBLE(v->cell[i]));
+
+    lval_del(v);
+    return x ? x : lval_num(num);
+}
+
+lval *builtin_add(lenv *e, lval *a)
+{
+    return builtin_op(e, a, LOP_ADD);
+}
+
+lval *builtin_sub(lenv *e, lval *a)
+{
+    return builtin_op(e, a, LOP_SUB);
+}
+
+lval *builtin_mul(lenv *e, lval *a)
+{
+    return builtin_op(e, a, LOP_MUL);
+}
+
+lval *builtin_div(lenv *e, lval *a)
+{
+    return builtin_op(e, a, LOP_DIV);
+}
+
+lval *builtin_mod(lenv *e, lval *a)
+{
+    return builtin_op(e, a, LOP_MOD);
+}
+
+lval *builtin_pow(lenv *e, lval *a)
+{
+    return builtin_op(e, a, LOP_POW);
+}
+
+/* Order of two numbers as -1, 0 or 1, or 2 if unordered. Exact unless one is a double */
+static int lval_num_cmp(lval *x, lval *y)
+{
+    if (x->type == LVAL_INT && y->type == LVAL_INT)
+        return (x->inum > y->inum) - (x->inum < y->inum);
+
+    /* Big integers are outside the int64 range, the sign decides */
+    if (LVAL_IS_EXACT(x) && LVAL_IS_EXACT(y))
+    {
+        if (x->type == LVAL_BIG && y->type == LVAL_BIG)
+            return lbig_cmp(x->big, y->big);
+        if (x->type == LVAL_BIG)
+            return x->big->neg ? -1 : 1;
+        return y->big->neg ? 1 : -1;
+    }
+
+    double dx = LVAL_AS_DOUBLE(x);
+    double dy = LVAL_AS_DOUBLE(y);
+    if (dx != dx || dy != dy)
+        return 2;
+    return (dx > dy) - (dx < dy);
+}
+
+lval *builtin_ord(lenv *e, lval *a, char *op)
+{
+    LASSERT_NUM(op, a, 2);
+
+    /* Vectors compare element by element into a vector of 0 and 1 */
+    if (a->cell[0]->type == LVAL_VEC || a->cell[1]->type == LVAL_VEC)
+    {
+        lval *x = a->cell[0]->type == LVAL_VEC ? a->cell[1] : a->cell[0];
+        LASSERT(a, LVAL_IS_NUM(x) || x->type == LVAL_VEC,
+                "Function '%s' cannot compare a Vector with %s.", op, ltype_name(x->type));
+
+        LVEC_OP vop = strcmp(op, ">") == 0    ? LVEC_GT
+                      : strcmp(op, "<") == 0  ? LVEC_LT
+                      : strcmp(op, ">=") == 0 ? LVEC_GE
+                                              : LVEC_LE;
+        lval *r = lvec_apply(vop, a->cell[0], a->cell[1], 0);
+        lval_del(a);
+        return r;
+    }
+    LASSERT_NUMBER(op, a, 0);
+    LASSERT_NUMBER(op, a, 1);
+
+    int c = lval_num_cmp(a->cell[0], a->cell[1]);
+    int r = 0;
+    if (strcmp(op, ">") == 0)
+        r = c == 1;
+    if (strcmp(op, "<") == 0)
+        r = c == -1;
+    if (strcmp(op, ">=") == 0)
+        r = c == 1 || c == 0;
+    if (strcmp(op, "<=") == 0)
+        r = c == -1 || c == 0;
+
+    lval_del(a);
+    return lval_int(r);
 }
 
-lval *builtin_op(lenv *e, lval *v, char *op)
+lval *builtin_gt(lenv *e, lval *a)
 {
-    /* Ensure all arguments are numbers */
-    for (int i = 0; i < v->count; ++i)
-    {
-        if (v->cell[i]->type != LVAL_NUM)
-        {
-            lval_del(v);
-            return lval_err(LERR_STR[OP_ON_NAN]);
-        }
-    }
+    return builtin_ord(e, a, ">");
+}
 
-    /* Pop the first element */
-    lval *x = lval_pop(v, 0);
+lval *builtin_lt(lenv *e, lval *a)
+{
+    return builtin_ord(e, a, "<");
+}
 
-    /* If no arguments and sub then perform unary negation */
-    if ((strcmp(op, "-") == 0) && v->count == 0)
-    {
-        x->num = -x->num;
-    }
+lval *builtin_ge(lenv *e, lval *a)
+{
+    return builtin_ord(e, a, ">=");
+}
 
-    /* While there are still arguments remaining */
-    while (v->count > 0)
-    {
-        /* Pop the next element */
-        lval *y = lval_pop(v, 0);
+lval *builtin_le(lenv *e, lval *a)
+{
+    return builtin_ord(e, a, "<=");
+}
 
-        if (strcmp(op, "+") == 0 || strcmp(op, "add") == 0)
-            x->num += y->num;
-        if (strcmp(op, "-") == 0 || strcmp(op, "sub") == 0)
-            x->num -= y->num;
-        if (strcmp(op, "*") == 0 || strcmp(op, "mul") == 0)
-            x->num *= y->num;
-        if (strcmp(op, "/") == 0 || strcmp(op, "div") == 0)
-        {
-            if (y->num == 0)
-            {
-                lval_del(x);
-                lval_del(y);
-                x = lval_err(LERR_STR[DIV_BY_ZERO]);
-                break;
-            }
-            x->num /= y->num;
-        }
-        if (strcmp(op, "%") == 0)
-        {
-            errno = 0;
-            int temp_x = (int)x->num;
-            int temp_y = (int)y->num;
-            if (errno == ERANGE)
-            {
-                lval_del(x);
-                lval_del(y);
-                x = lval_err(LERR_STR[MOD_ON_FLT_AND_OVFLW]);
-                break;
-            }
-            x->num = temp_x % temp_y;
-        }
-        if (strcmp(op, "^") == 0)
+/* Structural equality of two values */
+int lval_eq(lval *x, lval *y)
+{
+    /* Numbers of different types compare by value */
+    if (LVAL_IS_NUM(x) && LVAL_IS_NUM(y) && x->type != y->type)
+        return lval_num_cmp(x, y) == 0;
+    if (x->type != y->type)
+        return 0;
+
+    switch (x->type)
+    {
+    case LVAL_NUM:
+        return x->num == y->num;
+    case LVAL_INT:
+        return x->inum == y->inum;
+    case LVAL_BIG:
+        return lbig_cmp(x->big, y->big) == 0;
+    case LVAL_VEC:
+        if (x->vec->count != y->vec->count)
+            return 0;
+        for (int i = 0; i < x->vec->count; ++i)
         {
-            if (x->num < 0)
-            {
-                lval_del(x);
-                lval_del(y);
-                x = lval_err(LERR_STR[POW_ON_NEG]);
-                break;
-            }
-            else if (x->num == 0 && y->num == 0)
-                x->num = 1;
-            else
-                x->num = pow(x->num, y->num);
+            int eq = x->vec->elem == LVEC_I64 && y->vec->elem == LVEC_I64
+                         ? x->vec->i64[i] == y->vec->i64[i]
+                         : lvec_elem(x->vec, i) == lvec_elem(y->vec, i);
+            if (!eq)
+                return 0;
         }
-
-        lval_del(y);
+        return 1;
+    case LVAL_ERR:
+        return strcmp(x->err, y->err) == 0;
+    case LVAL_SYM:
+        return x->sym == y->sym;
+    case LVAL_FUNC:
+        if (x->builtin || y->builtin)
+            return x->builtin == y->builtin;
+        return lval_eq(x->formals, y->formals) && lval_eq(x->body, y->body);
+    case LVAL_PART:
+        return lval_eq(x->fn, y->fn) && lval_eq(x->bound, y->bound);
+    case LVAL_MEMO:
+        return x->memo == y->memo;
+    case LVAL_QEXPR:
+    case LVAL_SEXPR:
+        if (x->count != y->count)
+            return 0;
+        for (int i = 0; i < x->count; ++i)
+            if (!lval_eq(x->cell[i], y->cell[i]))
+                return 0;
+        return 1;
     }
+    return 0;
+}
 
-    lval_del(v);
-    return x;
+lval *builtin_cmp(lenv *e, lval *a, char *op)
+{
+    LASSERT_NUM(op, a, 2);
+
+    int r = lval_eq(a->cell[0], a->cell[1]);
+    if (strcmp(op, "!=") == 0)
+        r = !r;
+
+    lval_del(a);
+    return lval_int(r);
 }
 
-lval *builtin_add(lenv *e, lval *a)
+lval *builtin_eq(lenv *e, lval *a)
 {
-    return builtin_op(e, a, "+");
+    return builtin_cmp(e, a, "==");
 }
 
-lval *builtin_sub(lenv *e, lval *a)
+lval *builtin_ne(lenv *e, lval *a)
 {
-    return builtin_op(e, a, "-");
+    return builtin_cmp(e, a, "!=");
 }
 
-lval *builtin_mul(lenv *e, lval *a)
+/* Branch 'if' runs for arguments a, the Q-Expression as passed, or an error */
+lval *lval_if_code(lval *a)
 {
-    return builtin_op(e, a, "*");
+    LASSERT_NUM("if", a, 3);
+    LASSERT_NUMBER("if", a, 0);
+    LASSERT_TYPE("if", a, 1, LVAL_QEXPR);
+    LASSERT_TYPE("if", a, 2, LVAL_QEXPR);
+
+    /* Pick the branch by the condition */
+    lval *x = lval_pop(a, LVAL_AS_DOUBLE(a->cell[0]) ? 1 : 2);
+    lval_del(a);
+    return x;
 }
 
-lval *builtin_div(lenv *e, lval *a)
+/* Branch 'if' runs for arguments a as an S-Expression, or an error */
+lval *lval_if_branch(lval *a)
 {
-    return builtin_op(e, a, "/");
+    lval *x = lval_if_code(a);
+    if (x->type == LVAL_ERR)
+        return x;
+
+    x = lval_mut(x);
+    x->type = LVAL_SEXPR;
+    return x;
+}
+
+lval *builtin_if(lenv *e, lval *a)
+{
+    lval *x = lval_if_branch(a);
+    if (x->type == LVAL_ERR)
+        return x;
+
+    return lval_eval(e, x);
 }
 
 lval *builtin_head(lenv *e, lval *v)
@@ -986,14 +3385,8 @@ lval *builtin_head(lenv *e, lval *v)
     LASSERT(v, v->cell[0]->type == LVAL_QEXPR, LERR_STR[HEAD_TAIL_BAD_TYPE]);
     LASSERT(v, v->cell[0]->count != 0, LERR_STR[HEAD_TAIL_EMPTY]);
 
-    /* Otherwise take the first argument */
-    lval *x = lval_take(v, 0);
-
-    /* Delete all elements that are not head and return */
-    while (x->count > 1)
-        lval_del(lval_pop(x, 1));
-
-    return x;
+    /* Otherwise take the first argument, and view only its head */
+    return lval_slice(lval_take(v, 0), 0, 1);
 }
 
 lval *builtin_tail(lenv *e, lval *v)
@@ -1003,28 +3396,44 @@ lval *builtin_tail(lenv *e, lval *v)
     LASSERT(v, v->cell[0]->type == LVAL_QEXPR, LERR_STR[HEAD_TAIL_BAD_TYPE]);
     LASSERT(v, v->cell[0]->count != 0, LERR_STR[HEAD_TAIL_EMPTY]);
 
-    /* Take first argument */
+    /* Take first argument, and view all but its first element */
     lval *x = lval_take(v, 0);
-
-    /* Delete first element and return */
-    lval_del(lval_pop(x, 0));
-
-    return x;
+    return lval_slice(x, 1, x->count - 1);
 }
 
 lval *builtin_list(lenv *e, lval *v)
 {
+    v = lval_mut(v);
     v->type = LVAL_QEXPR;
     return v;
 }
 
-lval *builtin_eval(lenv *e, lval *v)
+/* Code 'eval' runs for arguments v, the Q-Expression as passed, or an error */
+lval *lval_eval_code(lval *v)
 {
     LASSERT(v, v->count == 1, "Function 'eval' passed too many arguments!");
     LASSERT(v, v->cell[0]->type == LVAL_QEXPR, "Function 'eval' passed incorrect type!");
 
-    lval *x = lval_take(v, 0);
+    return lval_take(v, 0);
+}
+
+/* S-Expression 'eval' runs for arguments v, or an error */
+lval *lval_eval_arg(lval *v)
+{
+    lval *x = lval_eval_code(v);
+    if (x->type == LVAL_ERR)
+        return x;
+
+    x = lval_mut(x);
     x->type = LVAL_SEXPR;
+    return x;
+}
+
+lval *builtin_eval(lenv *e, lval *v)
+{
+    lval *x = lval_eval_arg(v);
+    if (x->type == LVAL_ERR)
+        return x;
 
     return lval_eval(e, x);
 }
@@ -1038,7 +3447,12 @@ lval *builtin_join(lenv *e, lval *v)
                 "Function 'join' passed incorrect type.");
     }
 
-    lval *x = lval_pop(v, 0);
+    /* Room for every child up front, then each list is appended in one go */
+    int total = 0;
+    for (int i = 0; i < v->count; ++i)
+        total += v->cell[i]->count;
+
+    lval *x = lval_reserve(lval_pop(v, 0), total);
 
     while (v->count)
     {
@@ -1063,8 +3477,9 @@ lval *builtin_cons(lenv *e, lval *v)
 
 lval *builtin_len(lenv *e, lval *v)
 {
-    LASSERT(v, v->cell[0]->type == LVAL_QEXPR, "Function 'len' passed incorrect type!");
-    lval *x = lval_num(v->cell[0]->count);
+    LASSERT(v, v->cell[0]->type == LVAL_QEXPR || v->cell[0]->type == LVAL_VEC,
+            "Function 'len' passed incorrect type!");
+    lval *x = lval_int(v->cell[0]->type == LVAL_VEC ? v->cell[0]->vec->count : v->cell[0]->count);
     lval_del(v);
 
     return x;
@@ -1076,72 +3491,496 @@ lval *builtin_init(lenv *e, lval *v)
     LASSERT(v, v->cell[0]->type == LVAL_QEXPR, LERR_STR[HEAD_TAIL_BAD_TYPE]);
     LASSERT(v, v->cell[0]->count != 0, LERR_STR[HEAD_TAIL_EMPTY]);
 
-    lval *x = lval_pop(v->cell[0], v->cell[0]->count - 1);
-    lval_del(x);
+    lval *x = lval_take(v, 0);
+    return lval_slice(x, 0, x->count - 1);
+}
+
+lval *builtin_nth(lenv *e, lval *v)
+{
+    LASSERT_NUM("nth", v, 2);
+    LASSERT_TYPE("nth", v, 0, LVAL_QEXPR);
+    LASSERT_TYPE("nth", v, 1, LVAL_INT);
+
+    lval *q = v->cell[0];
+    int64_t i = v->cell[1]->inum;
+    LASSERT(v, i >= 0 && i < q->count,
+            "Function 'nth' passed index %lld, Expected 0 to %i.", (long long)i, q->count - 1);
+
+    lval *x = lval_copy(q->cell[i]);
+    lval_del(v);
+    return x;
+}
 
-    return v->cell[0];
+/* Children from start up to, but not including, end */
+lval *builtin_slice(lenv *e, lval *v)
+{
+    LASSERT_NUM("slice", v, 3);
+    LASSERT_TYPE("slice", v, 0, LVAL_QEXPR);
+    LASSERT_TYPE("slice", v, 1, LVAL_INT);
+    LASSERT_TYPE("slice", v, 2, LVAL_INT);
+
+    int64_t start = v->cell[1]->inum;
+    int64_t end = v->cell[2]->inum;
+    LASSERT(v, start >= 0 && start <= end && end <= v->cell[0]->count,
+            "Function 'slice' passed bounds %lld and %lld, Expected 0 <= start <= end <= %i.",
+            (long long)start, (long long)end, v->cell[0]->count);
+
+    return lval_slice(lval_take(v, 0), start, end - start);
 }
 
-int main(int argc, char **argv)
+/***********
+ * Vectors
+ ***********/
+
+lval *builtin_vec(lenv *e, lval *a)
+{
+    LASSERT_NUM("vec", a, 1);
+    LASSERT_TYPE("vec", a, 0, LVAL_QEXPR);
+
+    /* Int64 elements if every number is an integer that fits */
+    lval *q = a->cell[0];
+    int ints = 1;
+    for (int i = 0; i < q->count; ++i)
+    {
+        LASSERT(a, LVAL_IS_NUM(q->cell[i]),
+                "Function 'vec' passed %s at index %i, Expected Number.", ltype_name(q->cell[i]->type), i);
+        ints &= q->cell[i]->type == LVAL_INT;
+    }
+
+    lvec *x = lvec_new(ints ? LVEC_I64 : LVEC_F64, q->count);
+    for (int i = 0; i < q->count; ++i)
+    {
+        if (ints)
+            x->i64[i] = q->cell[i]->inum;
+        else
+            x->f64[i] = LVAL_AS_DOUBLE(q->cell[i]);
+    }
+
+    lval_del(a);
+    return lval_vec(x);
+}
+
+lval *builtin_unvec(lenv *e, lval *a)
+{
+    LASSERT_NUM("unvec", a, 1);
+    LASSERT_TYPE("unvec", a, 0, LVAL_VEC);
+
+    lvec *x = a->cell[0]->vec;
+    lval *q = lval_qexpr();
+    for (int i = 0; i < x->count; ++i)
+        lval_add_tail(q, x->elem == LVEC_I64 ? lval_int(x->i64[i]) : lval_num(x->f64[i]));
+
+    lval_del(a);
+    return q;
+}
+
+/* Exact sum, or product for LVEC_MUL, of int64 vectors that overflowed. With y the sum is of x[i] * y[i] */
+static lval *lvec_exact(LVEC_OP op, lvec *x, lvec *y)
 {
+    lbig *acc = lbig_from_int(op == LVEC_MUL ? 1 : 0);
+    for (int i = 0; i < x->count; ++i)
+    {
+        lbig *t = lbig_from_int(x->i64[i]);
+        if (y)
+        {
+            lbig *u = lbig_from_int(y->i64[i]);
+            lbig *p = lbig_mul(t, u);
+            lbig_del(u);
+            lbig_del(t);
+            t = p;
+        }
+
+        lbig *r = op == LVEC_MUL ? lbig_mul(acc, t) : lbig_add(acc, t);
+        lbig_del(t);
+        lbig_del(acc);
+        acc = r;
+    }
+    return lval_big(acc);
+}
+
+lval *builtin_dot(lenv *e, lval *a)
+{
+    LASSERT_NUM("dot", a, 2);
+    LASSERT_TYPE("dot", a, 0, LVAL_VEC);
+    LASSERT_TYPE("dot", a, 1, LVAL_VEC);
+
+    lvec *x = a->cell[0]->vec;
+    lvec *y = a->cell[1]->vec;
+    LASSERT(a, x->count == y->count, "Vectors of different lengths %i and %i.", x->count, y->count);
+
+    lval *r;
+    int64_t i;
+    if (x->elem == LVEC_I64 && y->elem == LVEC_I64)
+    {
+        r = lvec_i64_dot(x->i64, y->i64, x->count, &i) ? lvec_exact(LVEC_ADD, x, y) : lval_int(i);
+    }
+    else
+    {
+        lvec *xt = x->elem == LVEC_F64 ? NULL : lvec_to_f64(x);
+        lvec *yt = y->elem == LVEC_F64 ? NULL : lvec_to_f64(y);
+        r = lval_num(lvec_f64_dot(xt ? xt->f64 : x->f64, yt ? yt->f64 : y->f64, x->count));
+        lvec_del(xt);
+        lvec_del(yt);
+    }
+
+    lval_del(a);
+    return r;
+}
+
+/* Reductions of a single vector, the sum of int64 elements stays exact */
+static lval *builtin_vreduce(lval *a, char *func)
+{
+    LASSERT_NUM(func, a, 1);
+    LASSERT_TYPE(func, a, 0, LVAL_VEC);
+
+    lvec *x = a->cell[0]->vec;
+    int minmax = strcmp(func, "vmin") == 0 || strcmp(func, "vmax") == 0;
+    LASSERT(a, !minmax || x->count, "Function '%s' passed an empty Vector.", func);
+
+    lval *r;
+    int64_t i;
+    if (x->elem == LVEC_I64)
+    {
+        if (strcmp(func, "vsum") == 0)
+            r = lvec_i64_sum(x->i64, x->count, &i) ? lvec_exact(LVEC_ADD, x, NULL) : lval_int(i);
+        else if (strcmp(func, "vprod") == 0)
+            r = lvec_i64_prod(x->i64, x->count, &i) ? lvec_exact(LVEC_MUL, x, NULL) : lval_int(i);
+        else if (strcmp(func, "vmin") == 0)
+            r = lval_int(lvec_i64_min(x->i64, x->count));
+        else
+            r = lval_int(lvec_i64_max(x->i64, x->count));
+    }
+    else
+    {
+        if (strcmp(func, "vsum") == 0)
+            r = lval_num(lvec_f64_sum(x->f64, x->count));
+        else if (strcmp(func, "vprod") == 0)
+            r = lval_num(lvec_f64_prod(x->f64, x->count));
+        else if (strcmp(func, "vmin") == 0)
+            r = lval_num(lvec_f64_min(x->f64, x->count));
+        else
+            r = lval_num(lvec_f64_max(x->f64, x->count));
+    }
+
+    lval_del(a);
+    return r;
+}
+
+lval *builtin_vsum(lenv *e, lval *a)
+{
+    return builtin_vreduce(a, "vsum");
+}
+
+lval *builtin_vprod(lenv *e, lval *a)
+{
+    return builtin_vreduce(a, "vprod");
+}
+
+lval *builtin_vmin(lenv *e, lval *a)
+{
+    return builtin_vreduce(a, "vmin");
+}
+
+lval *builtin_vmax(lenv *e, lval *a)
+{
+    return builtin_vreduce(a, "vmax");
+}
+
+/*********
+ * Memos
+ *********/
+
+/* 'memo f' or 'memo f capacity', f with a table of its results */
+lval *builtin_memo(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1 || a->count == 2,
+            "Function 'memo' passed incorrect number of arguments. Got %i, Expected 1 or 2.", a->count);
+    int t = a->cell[0]->type;
+    LASSERT(a, t == LVAL_FUNC || t == LVAL_PART || t == LVAL_MEMO,
+            "Function 'memo' passed incorrect type for argument 0. Got %s, Expected Function.", ltype_name(t));
+
+    int64_t capacity = LMEMO_CAPACITY;
+    if (a->count == 2)
+    {
+        LASSERT_TYPE("memo", a, 1, LVAL_INT);
+        capacity = a->cell[1]->inum;
+        LASSERT(a, capacity > 0 && capacity <= INT32_MAX,
+                "Function 'memo' passed capacity %lld, Expected a positive size.", (long long)capacity);
+    }
+
+    lval *v = lval_new(LVAL_MEMO);
+    v->memo = lmemo_new(lval_copy(a->cell[0]), (int)capacity);
+    lval_del(a);
+    return v;
+}
+
+/* Counters of a memo as {hits misses entries capacity} */
+lval *builtin_memo_stats(lenv *e, lval *a)
+{
+    LASSERT_NUM("memo-stats", a, 1);
+    LASSERT_TYPE("memo-stats", a, 0, LVAL_MEMO);
+
+    size_t hits, misses;
+    int count, capacity;
+    lmemo_stats(a->cell[0]->memo, &hits, &misses, &count, &capacity);
+    lval_del(a);
+
+    lval *x = lval_qexpr();
+    x = lval_add_tail(x, lval_int((int64_t)hits));
+    x = lval_add_tail(x, lval_int((int64_t)misses));
+    x = lval_add_tail(x, lval_int(count));
+    x = lval_add_tail(x, lval_int(capacity));
+    return x;
+}
+
+/* Parsers of the lispy grammar */
+static mpc_parser_t *Number, *Symbol, *Sexpr, *Qexpr, *Expr, *Lispy;
+
+/*
+ * Get the parser of a whole input, building the grammar on first use.
+ * It is the grammar below, built from the parsers mpca_lang would make
+ * for it so that errors read the same, and its output is the lval of
+ * the input as an S-Expression:
+ *
+ *   number : /-?[0-9]+([.][0-9]*)?/;
+ *   symbol : /[a-zA-Z0-9_+\-*\/\\=<>!&]+/ | '%' | '^';
+ *   sexpr  : '(' <expr>* ')';
+ *   qexpr  : '{' <expr>* '}';
+ *   expr   : <number> | <symbol> | <sexpr> | <qexpr>;
+ *   lispy  : /^/ <expr>* /$/;
+ */
+mpc_parser_t *lispy_parser(void)
+{
+    if (Lispy)
+        return Lispy;
+
     /* Create some parsers */
-    mpc_parser_t *Number = mpc_new("number");
-    mpc_parser_t *Symbol = mpc_new("symbol");
-    mpc_parser_t *Sexpr = mpc_new("sexpr");
-    mpc_parser_t *Qexpr = mpc_new("qexpr");
-    mpc_parser_t *Expr = mpc_new("expr");
-    mpc_parser_t *Lispy = mpc_new("lispy");
-
-    /* Define them with following Language */
-    mpca_lang(MPCA_LANG_DEFAULT,
-              "\
-                number      : /-?[0-9]+([.][0-9]*)?/;\
-                symbol      : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ | '%' | '^';\
-                sexpr       : '(' <expr>* ')';\
-                qexpr       : '{' <expr>* '}';\
-                expr        : <number> | <symbol> | <sexpr> | <qexpr>;\
-                lispy       : /^/ <expr>* /$/;\
-              ",
-              Number, Symbol, Sexpr, Qexpr, Expr, Lispy);
+    Number = mpc_new("number");
+    Symbol = mpc_new("symbol");
+    Sexpr = mpc_new("sexpr");
+    Qexpr = mpc_new("qexpr");
+    Expr = mpc_new("expr");
+    Lispy = mpc_new("lispy");
+
+    /* Tokens skip the whitespace after them */
+    mpc_define(Number, mpc_apply(mpc_tok(mpc_re("-?[0-9]+([.][0-9]*)?")), lval_read_number));
+    mpc_define(Symbol, mpc_or(3,
+                              mpc_apply(mpc_tok(mpc_re("[a-zA-Z0-9_+\\-*/\\\\=<>!&]+")), lval_read_symbol),
+                              mpc_apply(mpc_tok(mpc_char('%')), lval_read_symbol),
+                              mpc_apply(mpc_tok(mpc_char('^')), lval_read_symbol)));
+    mpc_define(Sexpr, mpc_and(3, lval_read_sexpr,
+                              mpc_tok(mpc_char('(')), mpc_many(lval_read_list, Expr), mpc_tok(mpc_char(')')),
+                              free, lval_read_del));
+    mpc_define(Qexpr, mpc_and(3, lval_read_qexpr,
+                              mpc_tok(mpc_char('{')), mpc_many(lval_read_list, Expr), mpc_tok(mpc_char('}')),
+                              free, lval_read_del));
+    mpc_define(Expr, mpc_or(4, Number, Symbol, Sexpr, Qexpr));
+    mpc_define(Lispy, mpc_and(3, mpcf_snd_free,
+                              mpc_tok(mpc_re("^")), mpc_many(lval_read_list, Expr), mpc_tok(mpc_re("$")),
+                              free, lval_read_del));
+
+    return Lispy;
+}
+
+/* Undefine and Delete our Parsers */
+void lispy_parser_cleanup(void)
+{
+    if (!Lispy)
+        return;
+    mpc_cleanup(6, Number, Symbol, Sexpr, Qexpr, Expr, Lispy);
+    Lispy = NULL;
+}
+
+/* Options of main */
+static int region_mode = 0;
+static int fast_reader = 0;
+static int echo = 1;
+
+/**
+ * @brief Read, evaluate and print the expressions of some input
+ *
+ * Values are printed unless echo is off, errors always are.
+ *
+ * @param e Environment to evaluate in
+ * @param name Name of the input in error messages
+ * @param src Text of the input, len characters long, read as one S-Expression
+ * @param row Line of the input src starts on, for error positions
+ * @return 0 once exit was evaluated, 1 otherwise
+ */
+int lispy_eval(lenv *e, const char *name, const char *src, size_t len, long row)
+{
+    int running = 1;
+
+    /* Allocate the temporaries of each input from a region */
+    if (region_mode)
+        lval_region_begin();
+
+    /* Attempt to Parse the Input, as an S-Expression */
+    lval *x;
+    char *err = NULL;
+    mpc_result_t r;
+    if (fast_reader)
+        x = lread(name, src, len, row, &err);
+    else if (mpc_nparse(name, src, len, lispy_parser(), &r))
+        x = r.output;
+    else
+    {
+        x = NULL;
+        r.error->state.row += row;
+        err = mpc_err_string(r.error);
+        mpc_err_delete(r.error);
+    }
+
+    if (x)
+    {
+        if (lopt_enabled)
+            x = lopt_form(e, x);
+        x = lval_eval(e, x);
+        if (echo || x->type == LVAL_ERR)
+            lval_println(e, x);
+        test_exit(x, &running);
+        lval_del(x);
+    }
+    else
+    {
+        /* Otherwise Print the Error */
+        fputs(err, stdout);
+        free(err);
+    }
+
+    if (region_mode)
+        lval_region_end();
+
+    return running;
+}
+
+/* Print what is wrong with the command line and how to use it, giving the exit status */
+static int lispy_usage(char *fmt, char *arg)
+{
+    printf(fmt, arg);
+    puts("Usage: parsing [--region | --gc] [--opt] [--fast-reader] [-q]\n"
+         "       parsing [--region | --gc] [--opt] [--fast-reader] [-p] (script | - | -e expr)...\n"
+         "       parsing [--region | --gc] [--opt] [--fast-reader] --stream <file|->\n"
+         "       parsing --bench <name>");
+    return 1;
+}
+
+/* Whether a command line argument names a script, '-' being stdin */
+static int lispy_script_arg(char *arg)
+{
+    return arg[0] != '-' || strcmp(arg, "-") == 0;
+}
+
+int main(int argc, char **argv)
+{
+    /* Run micro benchmarks instead of the REPL */
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return lispy_bench(argc - 2, argv + 2);
+
+    char *stream = NULL;
+    int quiet = 0;
+    int print = 0;
+    int batch = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        /* Options taking an argument need one */
+        if ((strcmp(argv[i], "--stream") == 0 || strcmp(argv[i], "-e") == 0) && i + 1 == argc)
+            return lispy_usage("Option '%s' needs an argument\n", argv[i]);
+
+        if (strcmp(argv[i], "--region") == 0)
+            region_mode = 1;
+        /* Regions that are also collected while a form runs */
+        else if (strcmp(argv[i], "--gc") == 0)
+            region_mode = lgc.enabled = 1;
+        /* Run the optimizing pass over forms and lambda bodies */
+        else if (strcmp(argv[i], "--opt") == 0)
+            lopt_enabled = 1;
+        /* Read input with lread instead of the mpc grammar */
+        else if (strcmp(argv[i], "--fast-reader") == 0)
+            fast_reader = 1;
+        /* Evaluate the forms of a file, or of stdin for '-', as they are read */
+        else if (strcmp(argv[i], "--stream") == 0)
+            stream = argv[++i];
+        /* No banner or prompt */
+        else if (strcmp(argv[i], "-q") == 0)
+            quiet = 1;
+        /* Print the value of each form of scripts and expressions, not only errors */
+        else if (strcmp(argv[i], "-p") == 0)
+            print = 1;
+        /* Scripts and expressions are run in order, instead of the REPL */
+        else if (strcmp(argv[i], "-e") == 0)
+            batch = ++i;
+        else if (lispy_script_arg(argv[i]))
+            batch = i;
+        else
+            return lispy_usage("Unknown option '%s'\n", argv[i]);
+    }
+
+    /* A stream is the whole input */
+    if (stream && batch)
+        return lispy_usage("%s", "Option '--stream' cannot be combined with scripts or '-e'\n");
 
     lenv *env = lenv_new();
     lenv_add_builtins(env);
 
-    /* Print Version and Exit Information */
-    puts("Lispy Version 0.0.6");
-    puts("Press Ctrl+c to Exit\n");
+    if (stream)
+    {
+        int status = lstream_run(env, stream);
+        lispy_parser_cleanup();
+        return status;
+    }
+
+    if (batch)
+    {
+        int status = 0;
+        int running = 1;
+        echo = print;
+        for (int i = 1; i < argc && running; ++i)
+        {
+            if (strcmp(argv[i], "-e") == 0)
+            {
+                ++i;
+                running = lstream_text(env, "<expr>", argv[i], strlen(argv[i]));
+                if (!running)
+                    status = lispy_exit_status;
+            }
+            else if (lispy_script_arg(argv[i]))
+            {
+                running = lstream_script(env, argv[i]);
+                /* A script that cannot be read stops the run */
+                if (running < 0)
+                    status = 1;
+                else if (running == 0)
+                    status = lispy_exit_status;
+                running = running > 0;
+            }
+        }
+        lispy_parser_cleanup();
+        return status;
+    }
+
+    if (!quiet)
+    {
+        /* Print Version and Exit Information */
+        puts("Lispy Version 0.0.6");
+        puts("Press Ctrl+c to Exit\n");
+    }
 
     int running = 1;
     /* In a never ending loop */
     while (running)
     {
-        char *input = readline("lispy> ");
+        char *input = readline(quiet ? "" : "lispy> ");
+        if (!input)
+            break;
         add_history(input);
 
-        /* Attempt to Parse the user Input */
-        mpc_result_t r;
-        if (mpc_parse("<stdin>", input, Lispy, &r))
-        {
-            /* On Success Print the AST */
-            // mpc_ast_print(r.output);
-            lval *x = lval_eval(env, lval_read(r.output));
-            lval_println(env, x);
-            mpc_ast_delete(r.output);
-            test_exit(x, &running);
-            lval_del(x);
-        }
-        else
-        {
-            /* Otherwise Print the Error */
-            mpc_err_print(r.error);
-            mpc_err_delete(r.error);
-        }
+        running = lispy_eval(env, "<stdin>", input, strlen(input), 0);
 
         free(input);
     }
 
-    /* Undefine and Delete our Parsers */
-    mpc_cleanup(6, Number, Symbol, Sexpr, Qexpr, Expr, Lispy);
+    lispy_parser_cleanup();
 
-    return 0;
+    return running ? 0 : lispy_exit_status;
 }
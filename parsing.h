@@ -2,6 +2,8 @@
 //             Declaration
 //=============================================================
 
+#include <stdint.h>
+
 #define LASSERT(args, cond, fmt, ...)             \
     if (!(cond))                                  \
     {                                             \
@@ -22,14 +24,24 @@
             "Got %i, Expected %i.",                                \
             func, args->count, num)
 
+#define LASSERT_NUMBER(func, args, index)                           \
+    LASSERT(args, LVAL_IS_NUM(args->cell[index]),                   \
+            "Function '%s' passed incorrect type for argument %i. " \
+            "Got %s, Expected %s.",                                 \
+            func, index, ltype_name(args->cell[index]->type), ltype_name(LVAL_NUM))
+
 #define LASSERT_NOT_EMPTY(func, args, index)     \
     LASSERT(args, args->cell[index]->count != 0, \
             "Function '%s' passed {} for argument %i.", func, index);
 
 struct lval;
 struct lenv;
+struct lcode;
+struct lmemo;
 typedef struct lval lval;
 typedef struct lenv lenv;
+typedef struct lcode lcode;
+typedef struct lmemo lmemo;
 
 /* Create Enumeration of Possible lval Types */
 typedef enum LVAL_TYPE
@@ -40,8 +52,20 @@ typedef enum LVAL_TYPE
     LVAL_FUNC,
     LVAL_SEXPR,
     LVAL_QEXPR,
+    LVAL_INT,
+    LVAL_BIG,
+    LVAL_VEC,
+    LVAL_PART,
+    LVAL_MEMO,
 } LVAL_TYPE;
 
+/* Integers, big integers and doubles are all numbers */
+#define LVAL_IS_NUM(v) ((v)->type == LVAL_NUM || (v)->type == LVAL_INT || (v)->type == LVAL_BIG)
+#define LVAL_IS_EXACT(v) ((v)->type == LVAL_INT || (v)->type == LVAL_BIG)
+#define LVAL_AS_DOUBLE(v) ((v)->type == LVAL_INT   ? (double)(v)->inum \
+                           : (v)->type == LVAL_BIG ? lbig_to_double((v)->big) \
+                                                   : (v)->num)
+
 /* Create Enumeration of Error types */
 typedef enum LERR_TYPE
 {
@@ -58,60 +82,267 @@ typedef enum LERR_TYPE
     LERR_TYPE_NUM,
 } LERR_TYPE;
 
-/* Create Array of Error strings */
-char *LERR_STR[LERR_TYPE_NUM] = {
-    [DIV_BY_ZERO] = "Division by zero!",
-    [POW_ON_NEG] = "Pow base on negtive number!",
-    [OP_ON_NAN] = "Cannot operate on non-number!",
-    [STR_TO_NUM] = "This String cannot cast to number!",
-    [BAD_OP] = "This operation has not been support!",
-    [SEXPR_NO_FUNC] = "First element is not a function!",
-    [MOD_ON_FLT_AND_OVFLW] = "Numbers in mod-op shouldn't be float type!\n\
-Overflow occurred in type cast!",
-    [HEAD_TAIL_TOO_MANY_ARGS] = "Function 'head/tail' passed too many arguments!",
-    [HEAD_TAIL_BAD_TYPE] = "Function 'head/tail' passed incorrect types!",
-    [HEAD_TAIL_EMPTY] = "Function 'head/tail' passed {}!",
-};
+/* Array of Error strings, defined in parsing.c */
+extern char *LERR_STR[LERR_TYPE_NUM];
 
 typedef lval *(*lbuiltin)(lenv *, lval *);
 
-/* Declare New lval Struct */
+/* Operators of builtin_op */
+typedef enum LOP
+{
+    LOP_ADD = 0,
+    LOP_SUB,
+    LOP_MUL,
+    LOP_DIV,
+    LOP_MOD,
+    LOP_POW,
+    LOP_NUM,
+} LOP;
+
+/* Reference count of preallocated values that are never freed */
+#define LVAL_IMMORTAL -1
+
+/* Flag of lval and lenv nodes living in the current form's region */
+#define LVAL_REGION 1
+
+/* Flag of heap values whose last env reference went during the form */
+#define LVAL_DEAD 2
+
+/*
+ * Cells of lists, shared by every list viewing a run of them. Slots lo
+ * to hi hold a counted reference each, the free slots on either side
+ * are taken by whichever list ends next to them, so cons and append
+ * leave the lists that shared the block unchanged.
+ */
+typedef struct lcells
+{
+    int ref;
+    int flags;
+    int lo;
+    int hi;
+    int cap;
+    struct lval *slot[];
+} lcells;
+
+/* Declare New lval Struct, only the payload of its type is allocated */
 typedef struct lval
 {
-    int type;
-    char *name;
-    double num;
+    unsigned char type;
+    unsigned char flags;
+    int ref;
 
-    /* Error and symbol types have string data */
-    char *err;
-    char *sym;
+    union
+    {
+        double num;
+        int64_t inum;
 
-    /* Function */
-    lbuiltin builtin;
-    lenv *env;
-    lval *formals;
-    lval *body;
+        /* Only integers outside the int64 range are big, see lval_big */
+        lbig *big;
 
-    /* Count and Point to a list of "lval*" */
-    int count;
-    struct lval **cell;
+        /* Packed numbers, see lvec.h */
+        lvec *vec;
+
+        /* Function with a table of its results, see lmemo.c */
+        lmemo *memo;
+
+        /* Error and symbol types have string data, symbols are interned */
+        char *err;
+        char *sym;
+
+        /* Function, builtin is NULL for lambdas */
+        struct
+        {
+            lbuiltin builtin;
+            union
+            {
+                char *name; /* interned */
+                struct
+                {
+                    lenv *env;
+                    lval *formals;
+                    lval *body;
+                    lcode *code; /* compiled body, NULL until first call */
+                };
+            };
+        };
+
+        /* Partial application, lambda fn runs once bound and later arguments fill its formals */
+        struct
+        {
+            lval *fn;
+            lval *bound;
+        };
+
+        /* Count and Point to a list of "lval*", a run of the slots of blk */
+        struct
+        {
+            int count;
+            lcells *blk;
+            struct lval **cell;
+            lcode *compiled; /* code of the list run by eval or if, see lvm.c */
+        };
+    };
 } lval;
 
+/* Totals of region mode, each form's region is a nursery dropped at its end */
+typedef struct lform_stat
+{
+    size_t forms;
+    size_t bytes;    /* allocated from regions */
+    size_t promoted; /* region values copied to the heap */
+    double pause_ns; /* spent dropping regions */
+    double pause_max_ns;
+    size_t peak; /* largest region */
+
+    /* Minor collections with --gc, see lgc_collect */
+    size_t collections;
+    size_t copied; /* bytes of survivors */
+    double gc_ns;
+    double gc_max_ns;
+} lform_stat;
+
+/*
+ * With --gc, locals holding region values while evaluation may reach a
+ * safe point are pushed on a shadow stack of roots, and code keeping
+ * them in other locals pins the region, see lgc_collect.
+ */
+typedef struct lgc_roots
+{
+    int enabled;
+    int pinned;
+    uintptr_t *slots; /* lval ** slots, lenv ** ones have the low bit set */
+    int count;
+    int cap;
+} lgc_roots;
+
+extern lgc_roots lgc;
+void lgc_grow(void);
+void lgc_safepoint(void);
+
+static inline void lgc_push(lval **v)
+{
+    if (!lgc.enabled)
+        return;
+    if (lgc.count == lgc.cap)
+        lgc_grow();
+    lgc.slots[lgc.count++] = (uintptr_t)v;
+}
+
+static inline void lgc_push_env(lenv **e)
+{
+    if (!lgc.enabled)
+        return;
+    if (lgc.count == lgc.cap)
+        lgc_grow();
+    lgc.slots[lgc.count++] = (uintptr_t)e | 1;
+}
+
+static inline void lgc_pop(int n)
+{
+    if (lgc.enabled)
+        lgc.count -= n;
+}
+
+static inline void lgc_pin(void)
+{
+    lgc.pinned++;
+}
+
+static inline void lgc_unpin(void)
+{
+    lgc.pinned--;
+}
+
+/* Collect the region if it is due and nothing pins it */
+static inline void lgc_poll(void)
+{
+    if (lgc.enabled && !lgc.pinned)
+        lgc_safepoint();
+}
+
+/* Flag of frames that gained bindings after their arguments were bound */
+#define LENV_EXTENDED 2
+
+/* Flag of frames whose arguments are being bound */
+#define LENV_BINDING 4
+
+/* Environments smaller than this are scanned linearly */
+#define LENV_INDEX_MIN 8
+
 struct lenv
 {
-    lenv *par;
+    lenv *par; /* counted */
+    int flags;
+    int ref;
+
+    /* Heap copy of a region env once promoted */
+    lenv *fwd;
+
     int count;
-    char **syms;
+    char **syms; /* interned */
     lval **vals;
+
+    /* Open-addressing index into syms/vals, -1 marks a free slot */
+    int cap;
+    int *index;
 };
 
+/* Checked int64 arithmetic, nonzero if the result does not fit */
+static inline int lint_add(int64_t x, int64_t y, int64_t *r)
+{
+#if defined(__GNUC__)
+    return __builtin_add_overflow(x, y, r);
+#else
+    if ((y > 0 && x > INT64_MAX - y) || (y < 0 && x < INT64_MIN - y))
+        return 1;
+    *r = x + y;
+    return 0;
+#endif
+}
+
+static inline int lint_sub(int64_t x, int64_t y, int64_t *r)
+{
+#if defined(__GNUC__)
+    return __builtin_sub_overflow(x, y, r);
+#else
+    if ((y < 0 && x > INT64_MAX + y) || (y > 0 && x < INT64_MIN + y))
+        return 1;
+    *r = x - y;
+    return 0;
+#endif
+}
+
+static inline int lint_mul(int64_t x, int64_t y, int64_t *r)
+{
+#if defined(__GNUC__)
+    return __builtin_mul_overflow(x, y, r);
+#else
+    if (x > 0 ? (y > 0 ? x > INT64_MAX / y : y < INT64_MIN / x)
+              : (y > 0 ? x < INT64_MIN / y : x != 0 && y < INT64_MAX / x))
+        return 1;
+    *r = x * y;
+    return 0;
+#endif
+}
+
 char *ltype_name(int t);
 
+extern char *lsym_amp;
+extern char *lsym_if;
+extern char *lsym_exit;
+extern char *lsym_penv;
+char *lsym_intern(char *s);
+
+extern int lispy_exit_status;
 void test_exit(lval *v, int *p_flag);
 
 lenv *lenv_new(void);
 void lenv_del(lenv *env);
-lenv *lenv_copy(lenv *e);
+void lenv_drop(lenv *env);
+lenv *lenv_ref(lenv *e);
+lenv *lenv_promote(lenv *e);
+int lenv_find(lenv *e, char *sym);
+lenv *lenv_frame(lenv *par, char **syms, lval **vals, int n);
 lval *lenv_get_value(lenv *e, lval *k);
 lval *lenv_get_key(lenv *e, lbuiltin v);
 void lenv_def(lenv *e, lval *k, lval *v);
@@ -119,42 +350,111 @@ void lenv_put(lenv *e, lval *k, lval *v);
 void lenv_add_builtin(lenv *e, char *name, lbuiltin func);
 void lenv_add_builtins(lenv *e);
 
-lval *lval_new(void);
+size_t lval_size(int type);
+lval *lval_new(int type);
 lval *lval_num(double x);
+lval *lval_int(int64_t x);
+lval *lval_big(lbig *b);
+lval *lval_vec(lvec *x);
 lval *lval_err(char *fmt, ...);
 lval *lval_sym(char *s);
 lval *lval_sexpr(void);
 lval *lval_qexpr(void);
 lval *lval_func(lbuiltin func);
-lval *lval_lambda(lval *formals, lval *body);
+lval *lval_lambda(lenv *e, lval *formals, lval *body);
+lval *lval_part(lval *fn, lval *bound);
 
+lval *lval_reserve(lval *v, int n);
+lval *lval_add_cells(lval *v, lval **xs, int n);
 lval *lval_add_tail(lval *v, lval *x);
 lval *lval_add_head(lval *v, lval *x);
 lval *lval_set_name(lval *v, char *name);
 lval *lval_copy(lval *v);
+lval *lval_dup(lval *v);
+lval *lval_mut(lval *v);
+lval *lval_promote(lval *v);
+void lval_release(lval *v);
+void lval_region_begin(void);
+void lval_region_end(void);
+void lval_region_stats(lform_stat *s);
 void lval_del(lval *v);
 lval *lval_take(lval *v, int i);
 lval *lval_pop(lval *v, int i);
 lval *lval_join(lval *x, lval *y);
+lval *lval_slice(lval *v, int i, int n);
 
 lval *lval_eval_sexpr(lenv *e, lval *v);
 lval *lval_eval(lenv *e, lval *v);
+lval *lval_read_num(char *s);
 
 lval *lval_call(lenv *e, lval *f, lval *a);
+lval *lval_bind(lval *f, lval *a, lenv **frame);
+lval *lval_eval_code(lval *v);
+lval *lval_eval_arg(lval *v);
+lval *lval_if_code(lval *a);
+lval *lval_if_branch(lval *a);
+int lval_eq(lval *x, lval *y);
+
+/* Bytecode VM, see lvm.c */
+extern int lvm_enabled;
+lval *lvm_exec(lval *f, lenv *env);
+void lvm_roots(void (*val)(lval **), void (*env)(lenv **));
+lcode *lval_code(lval *f);
+lcode *lcode_copy(lcode *c);
+void lcode_del(lcode *c);
+
+/* Hand-written reader, see lread.c */
+lval *lread(const char *filename, const char *src, size_t len, long row, char **err);
+
+/* Streaming evaluation of files, see lstream.c */
+int lstream_run(lenv *e, const char *path);
+int lstream_text(lenv *e, const char *name, const char *src, size_t len);
+int lstream_script(lenv *e, const char *path);
+
+/* Optimizing pass, see lopt.c */
+extern int lopt_enabled;
+extern unsigned lopt_version;
+void lopt_rebind(char *sym);
+lval *lopt_form(lenv *e, lval *v);
+lval *lopt_body(lval *f);
+lcode **lopt_code_slot(lval *f);
+void lopt_forget(lval *f);
+
+/* Memoized functions, see lmemo.c */
+#define LMEMO_CAPACITY 1024
+lmemo *lmemo_new(lval *fn, int capacity);
+lmemo *lmemo_copy(lmemo *m, lval *(*keep)(lval *));
+void lmemo_del(lmemo *m, int drop);
+lval *lmemo_fn(lmemo *m);
+void lmemo_stats(lmemo *m, size_t *hits, size_t *misses, int *count, int *capacity);
+lval *lmemo_call(lenv *e, lval *v, lval *a);
 
 // lval *builtin(lenv *e, lval *v, char *func);
 lval *builtin_exit(lenv *e, lval *a);
 lval *builtin_penv(lenv *e, lval *a);
+lval *builtin_mem(lenv *e, lval *a);
 lval *builtin_def(lenv *e, lval *a);
 lval *builtin_put(lenv *e, lval *a);
 lval *builtin_var(lenv *e, lval *a, char *func);
 lval *builtin_lambda(lenv *e, lval *a);
 
-lval *builtin_op(lenv *e, lval *v, char *op);
+lval *builtin_op(lenv *e, lval *v, LOP op);
 lval *builtin_add(lenv *e, lval *a);
 lval *builtin_sub(lenv *e, lval *a);
 lval *builtin_mul(lenv *e, lval *a);
 lval *builtin_div(lenv *e, lval *a);
+lval *builtin_mod(lenv *e, lval *a);
+lval *builtin_pow(lenv *e, lval *a);
+
+lval *builtin_ord(lenv *e, lval *a, char *op);
+lval *builtin_gt(lenv *e, lval *a);
+lval *builtin_lt(lenv *e, lval *a);
+lval *builtin_ge(lenv *e, lval *a);
+lval *builtin_le(lenv *e, lval *a);
+lval *builtin_cmp(lenv *e, lval *a, char *op);
+lval *builtin_eq(lenv *e, lval *a);
+lval *builtin_ne(lenv *e, lval *a);
+lval *builtin_if(lenv *e, lval *a);
 
 lval *builtin_head(lenv *e, lval *v);
 lval *builtin_tail(lenv *e, lval *v);
@@ -164,6 +464,25 @@ lval *builtin_join(lenv *e, lval *v);
 lval *builtin_cons(lenv *e, lval *v);
 lval *builtin_len(lenv *e, lval *v);
 lval *builtin_init(lenv *e, lval *v);
+lval *builtin_nth(lenv *e, lval *v);
+lval *builtin_slice(lenv *e, lval *v);
+
+lval *builtin_vec(lenv *e, lval *a);
+lval *builtin_unvec(lenv *e, lval *a);
+lval *builtin_dot(lenv *e, lval *a);
+lval *builtin_vsum(lenv *e, lval *a);
+lval *builtin_vprod(lenv *e, lval *a);
+lval *builtin_vmin(lenv *e, lval *a);
+lval *builtin_vmax(lenv *e, lval *a);
+
+lval *builtin_memo(lenv *e, lval *a);
+lval *builtin_memo_stats(lenv *e, lval *a);
 
 void lval_expr_print(lenv *e, lval *v, char open, char close);
 void lval_print(lenv *e, lval *v);
+
+mpc_parser_t *lispy_parser(void);
+void lispy_parser_cleanup(void);
+
+int lispy_eval(lenv *e, const char *name, const char *src, size_t len, long row);
+int lispy_bench(int argc, char **argv);
@@ -0,0 +1,20 @@
++ 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17
+* 1 2 3 4 5 6 7 8 9 10
+- 100 1 2 3
+/ 100 2 5
++ 1.5 2 3
+- 1 2.5
+max 1 2
++ 1 {2}
++
+- 0.0
+^ 2 0.5
+^ -8 0.5
+% 7.5 2
+% 10 0
+/ 0.0 0.0
+< 1 2 3
+== 1 1
+== {1 2} {1 2}
+!= {1 2} {1 3}
++ 1 (+ 2 (+ 3 (+ 4 5)))
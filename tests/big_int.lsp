@@ -0,0 +1,16 @@
++ 9223372036854775807 1
+- -9223372036854775807 10
+* 4294967296 4294967296
+- (* 4294967296 4294967296) (* 4294967296 4294967296)
+^ 2 100
+/ (^ 2 100) (^ 2 98)
+% (^ 10 30) 7
+== (^ 2 64) (* 4294967296 4294967296)
+< (^ 2 64) 1.0
++ (^ 2 64) 0.5
+123456789012345678901234567890
+-123456789012345678901234567890
+/ 1 0
+def {fact} (\ {n} {if (== n 0) {1} {* n (fact (- n 1))}})
+fact 25
+/ (fact 25) (fact 23)
@@ -0,0 +1,20 @@
+def {a} {1 2 3}
+def {b} a
+def {c} (join a {4})
+def {d} (cons 0 a)
+def {e} (tail a)
+a
+b
+c
+d
+e
+def {a} (join a {9})
+a
+b
+def {f} (\ {l} {join l {5}})
+f b
+f b
+b
+def {g} (\ {l} {(\ {x} {l}) (= {l} (cons 0 l))})
+g b
+b
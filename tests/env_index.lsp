@@ -0,0 +1,13 @@
+def {a b c d e f g h i j k l} 1 2 3 4 5 6 7 8 9 10 11 12
++ a b c d e f g h i j k l
+def {g} 70
++ a g l
+def {many} (\ {a b c d e f g h i j} {+ a j (* 100 (- g e))})
+many 1 2 3 4 5 6 7 8 9 10
+def {grow} (\ {x} {(\ {o0 o1 o2 o3 o4 o5 o6 o7 o8 o9} {+ x z w a}) (= {z} 1) (= {w} 2) (= {v} 3) (= {u} 4) (= {t} 5) (= {s} 6) (= {r} 7) (= {q} 8) (= {p} 9) (= {a} 1000)})
+grow 5
+a
+def {sym1 sym2 sym3 sym4 sym5 sym6 sym7 sym8 sym9} 1 2 3 4 5 6 7 8 9
+def {sym9} (+ sym1 sym8)
+sym9
+unknown
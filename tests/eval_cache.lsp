@@ -0,0 +1,18 @@
+def {q} {+ x 1}
+def {f} (\ {x} {eval q})
+def {g} (\ {y x} {eval q})
+f 1
+g 5 10
+f 2
+def {q} {* x 2}
+f 3
+def {h} (\ {x b} {if (> x 0) b {0}})
+h 4 {x}
+h 4 {+ x x}
+h 0 {x}
+def {m} (\ {x} {(\ {a} {eval {+ x z}}) (= {z} (* x 2))})
+m 3
+m 4
+def {k} (\ {c} {eval (cons + c)})
+k {1 2}
+k {3 4}
@@ -0,0 +1,19 @@
+def {mk} (\ {x} {= {h} (\ {} {x})})
+def {loop} (\ {n} {if (== n 0) {0} {loop (+ (- n 1) (* 0 (len (list (mk n)))))}})
+loop 1000000
+def {cnt} (\ {n} {(\ {a} {r n}) (= {r} (\ {k} {if (== k 0) {0} {+ 1 (r (- k 1))}}))})
+cnt 10
+def {mk2} (\ {x} {(\ {a} {h}) (= {h} (\ {} {x}))})
+(mk2 5)
+def {mk} (\ {x} {(\ {a} {1}) (= {h} (list (\ {y} {+ x y}) x))})
+def {loop} (\ {n} {if (== n 0) {0} {loop (- n (mk 1))}})
+loop 500000
+def {mkp} (\ {x} {(\ {a} {1}) (= {p} ((\ {a b} {+ a b}) x))})
+def {loopp} (\ {n} {if (== n 0) {0} {loopp (- n (mkp 1))}})
+loopp 500000
+def {keep} (\ {x} {(\ {a} {h}) (= {h} (list (\ {y} {+ x y})))})
+def {got} (keep 7)
+(eval (head got)) 1
+def {kp} (\ {x} {(\ {a} {p}) (= {p} ((\ {a b} {+ a b x}) 1))})
+def {add} (kp 10)
+add 5
@@ -0,0 +1,23 @@
+def {x} 100
+def {adder} (\ {a} {\ {b} {\ {c} {+ a b c x}}})
+((adder 1) 2) 3
+def {add12} ((adder 1) 2)
+add12 30
+add12 40
+def {shadow} (\ {x} {(\ {x} {* x 2}) (+ x 1)})
+shadow 5
+def {outer} (\ {y} {(\ {z} {+ y z x}) 1})
+outer 10
+def {late} (\ {y} {(\ {a b} {+ y x}) (= {x} 1000) 0})
+late 1
+late 2
+x
+def {rest} (\ {a & r} {list a r})
+rest 1 2 3
+rest 1
+def {swap} (\ {a b} {(\ {a b} {list a b}) b a})
+swap 1 2
+def {counter} (\ {n} {\ {k} {+ n k}})
+def {c5} (counter 5)
+def {c7} (counter 7)
+list (c5 1) (c7 1) (c5 2)
@@ -0,0 +1,20 @@
+def {build} (\ {n acc} {if (== n 0) {acc} {build (- n 1) (cons n acc)}})
+def {sum} (\ {l acc} {if (== l {}) {acc} {sum (tail l) (+ acc (eval (head l)))}})
+sum (build 100000 {}) 0
+def {adders} (\ {n acc} {if (== n 0) {acc} {adders (- n 1) (cons (\ {x} {+ x n}) acc)}})
+def {apply} (\ {fs x acc} {if (== fs {}) {acc} {apply (tail fs) x (+ acc ((nth fs 0) x))}})
+apply (adders 10000 {}) 1 0
+def {parts} (\ {n acc} {if (== n 0) {acc} {parts (- n 1) (cons ((\ {a b} {* a b}) n) acc)}})
+apply (parts 10000 {}) 2 0
+def {fib} (\ {n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n 2))}})
+def {calls} (\ {f n acc} {if (== n 0) {acc} {calls f (- n 1) (+ acc (f 15))}})
+calls (memo fib) 2000 0
+def {local} (\ {n} {(\ {a b} {+ x (len y)}) (= {x} n) (= {y} (build n {}))})
+def {locals} (\ {n acc} {if (== n 0) {acc} {locals (- n 1) (+ acc (local 50))}})
+locals 10000 0
+def {vecs} (\ {n v} {if (== n 0) {v} {vecs (- n 1) (+ v (vec {1 2 3}))}})
+vecs 100000 (vec {0 0 0})
+def {bigs} (\ {n b} {if (== n 0) {b} {bigs (- n 1) (+ b 123456789012345678901234567890)}})
+bigs 100000 0
+def {spin} (\ {n} {if (== n 0) {0} {spin (+ (- n 1) (* 0 (len (build 20 {}))))}})
+spin 100000
@@ -0,0 +1,20 @@
+def {n} 1
+def {get} (\ {x} {+ n x})
+get 0
+def {n} 2
+get 0
+def {wrap} (\ {x} {get x})
+wrap 1
+def {shade} (\ {x} {(\ {a} {+ n x}) (= {n} 10)})
+shade 5
+get 0
+def {late} (\ {x} {later})
+late 0
+def {later} 7
+late 0
+def {later} 8
+late 0
+def {inner} (\ {x} {(\ {a} {get x}) (= {get} (\ {y} {100}))})
+inner 0
+get 0
+wrap 3
@@ -0,0 +1,14 @@
++ 1 2
+/ 7 2
+/ 6 3
+/ 7 2.0
+% 7 3
+% -7 3
+* 3 1.5
+^ 2 10
+== 2 2.0
++ 1 0.5
+- 5
+* 2 3 4
+< 1 2
+>= 2.5 3
@@ -0,0 +1,19 @@
+def {a} {1 2 3}
+def {b} (join a {4})
+def {c} (join a {5})
+a
+b
+c
+def {t} (tail b)
+def {d} (join t {6 7})
+b
+d
+def {i} (init d)
+join i {8}
+d
+def {slide} (\ {k q} {if (== k 0) {q} {slide (- k 1) (join (tail q) (list k))}})
+def {q} {1 2 3 4 5 6 7}
+slide 10 q
+q
+cons 0 (tail q)
+q
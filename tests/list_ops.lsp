@@ -0,0 +1,20 @@
+def {fill} (\ {n l} {if (== n 0) {l} {fill (- n 1) (join l (list n))}})
+def {l} (fill 1000 {})
+len l
+nth l 0
+nth l 999
+nth l 1000
+def {drop} (\ {n l} {if (== n 0) {l} {drop (- n 1) (tail l)}})
+drop 995 l
+len l
+init {1 2 3}
+init {}
+tail {}
+head {}
+slice {a b c d e} 1 3
+slice {a b c d e} 3 3
+slice {a b c d e} 4 9
+def {q} (\ {n l} {if (== n 0) {l} {q (- n 1) (tail (join l (list n)))}})
+q 10000 {a b c}
+cons {x} {y}
+join {1} {} {2 3} {}
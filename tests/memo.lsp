@@ -0,0 +1,36 @@
+def {fib} (\ {n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n 2))}})
+def {fib} (memo fib)
+fib 60
+memo-stats fib
+fib 60
+memo-stats fib
+def {sq} (memo (\ {x} {* x x}) 2)
+sq 3
+sq 4
+sq 3
+sq 5
+sq 4
+memo-stats sq
+def {bad} (memo (\ {x} {/ 1 x}))
+bad 0
+bad 0
+memo-stats bad
+def {pair} (memo (\ {x y} {list x y}))
+pair {a b} 1
+pair {a b} 1
+pair 1.0 1
+pair 1 1
+memo-stats pair
+def {add} (\ {a b} {+ a b})
+def {add10} (memo (add 10))
+add10 1
+add10 1
+add10 {2}
+memo-stats add10
+def {twice} (memo sq)
+twice 6
+twice 6
+memo-stats twice
+memo-stats sq
+memo 1
+memo (\ {x} {x}) 0
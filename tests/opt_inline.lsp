@@ -0,0 +1,13 @@
+def {g} (\ {x} {eval x})
+def {q} {x}
+g q
+def {h} (\ {s v} {= s v})
+def {r} {zz}
+h r 5
+zz
+def {ap} (\ {f a} {f a})
+ap head {1 2}
+def {br} (\ {c a b} {if c a b})
+br 1 {q} {2}
+def {sq} (\ {x} {* x x})
+sq 5
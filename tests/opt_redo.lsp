@@ -0,0 +1,14 @@
+def {sq} (\ {x} {* x x})
+def {use} (\ {x} {+ (sq x) 1})
+use 3
+def {sq} (\ {x} {+ x x})
+use 3
+def {same} use
+same 4
+def {f} (\ {n} {if (== n 0) {sq 2} {+ (sq n) ((\ {s} {f (- n 1)}) (= {sq} 0))}})
+f 3
+f 3
+def {sq} (\ {x} {- x 1})
+f 3
+use 3
+same 4
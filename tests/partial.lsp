@@ -0,0 +1,26 @@
+def {add3} (\ {a b c} {+ a b c})
+add3 1
+(add3 1) 2
+((add3 1) 2) 3
+def {inc} (add3 1 0)
+inc 41
+inc 1 2
+def {pair} (\ {a & r} {list a r})
+pair
+(pair) 1 2
+def {p} (add3 10)
+p 1 2
+p 3 4
+(\ {f} {f 1}) (add3 5 6)
+(eval (list add3 1 2)) 3
+add3 {1} 2 3
+def {lenf} (\ {a b} {list (len a) b})
+def {pl} (lenf {1 2 3})
+pl 1
+pl 2
+pl 3
+def {tri} (\ {a b & r} {list a b r})
+def {pt} (tri {x y})
+pt 1
+pt 2 3 4
+pt 5
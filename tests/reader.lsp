@@ -0,0 +1,15 @@
+list 1 -2 3.5 -0.25 7. 007
+list 123456789012345678901234567890 -98765432109876543210
+list {a_b c-d e+f g*h i/j k\l m=n o<p q>r s!t u&v % ^}
+list {} {{}} {{a} {b {c}}}
+head {(+ 1 2) {x y}}
++ 1 (* 2 3) (- 10 (/ 8 2))
+   + 1 2   
++ 1 $
++ 1 2)
+- 1
+{a b
++ 1 2}
+(+ 1 2
+{a b
++ 1 2)
@@ -0,0 +1,12 @@
+def {y} {1 2 3}
+def {z} ((\ {old u} {list old}) y (def {y} 0))
+def {w} {a b c d e f g h}
+z
+def {k} (\ {x} {x})
+def {j} ((\ {old u} {list old}) k (def {k} 0))
+def {w} {a b c d e f g h}
+def {g} (eval (head j))
+g 5
+def {b} {1 2 3}
+(\ {l} {(\ {x} {l}) (= {l} 5)}) b
+b
@@ -0,0 +1,27 @@
+# Run the interpreter on a script and compare what it prints with the expected output.
+# With STDIN set the script is fed on stdin instead of being named after ARGS.
+# With LIMIT_KB set the run is capped to that much address space, where the shell can do so.
+separate_arguments(ARGS)
+set(command ${LISPY} ${ARGS})
+set(input)
+if(STDIN)
+    set(input INPUT_FILE ${SCRIPT})
+else()
+    list(APPEND command ${SCRIPT})
+endif()
+if(NOT STATUS)
+    set(STATUS 0)
+endif()
+if(LIMIT_KB AND UNIX)
+    set(command sh -c "ulimit -v ${LIMIT_KB} && exec \"$0\" \"$@\"" ${command})
+endif()
+
+execute_process(COMMAND ${command}
+                ${input}
+                OUTPUT_VARIABLE out
+                RESULT_VARIABLE status)
+file(READ ${EXPECTED} expected)
+
+if(NOT status EQUAL STATUS OR NOT out STREQUAL expected)
+    message(FATAL_ERROR "${SCRIPT} ${ARGS} exited with ${status} and printed:\n${out}\nexpected status ${STATUS} and:\n${expected}")
+endif()
@@ -0,0 +1,4 @@
++ 1 1
+/ 1 0
+def {x} 5
+x
@@ -0,0 +1,7 @@
+- 1.0
+- 0 128.0
+- 0.0
+* -1.0 0
+/ -3.0 1
++ -128 -1
+- 0 129
@@ -0,0 +1,3 @@
++ 1 1
+exit 1
++ 2 2
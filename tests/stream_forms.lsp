@@ -0,0 +1,14 @@
+def {x} 1
+(+ x
+   2)
+def {f} (\ {a}
+  {+ a x})
+f 5
+{a {b
+c}}
+(+ 1 2))
+(+ 3
+ 4)
+def {x}
+  100
+f 5
@@ -0,0 +1,13 @@
+== {abc} {abc}
+== {abc} {abd}
+== (head {x y}) {x}
+!= (tail {x y}) {y}
+== {a_very_long_symbol_name_that_is_read_twice} {a_very_long_symbol_name_that_is_read_twice}
+== {a_very_long_symbol_name_that_is_read_twice} {a_very_long_symbol_name_that_is_read_thrice}
+def (join {k1} {k2}) 1 2
++ k1 k2
+def {pick} (\ {s} {== s {k2}})
+pick {k2}
+pick (tail {k1 k2})
+pick {k1}
+eval (join {+} (head {k1}) {k2})
@@ -0,0 +1,11 @@
+def {count} (\ {n acc} {if (== n 0) {acc} {count (- n 1) (+ acc 1)}})
+count 1000000 0
+def {even} (\ {n} {if (== n 0) {1} {odd (- n 1)}})
+def {odd} (\ {n} {if (== n 0) {0} {even (- n 1)}})
+even 1000001
+def {via} (\ {n} {if (== n 0) {{done}} {eval (join {via} (list (- n 1)))}})
+via 300000
+def {step} (\ {k n} {if (== n 0) {k} {(step k) (- n 1)}})
+step 7 300000
+def {deep} (\ {n} {if (== n 0) {0} {+ 1 (deep (- n 1))}})
+deep 100000
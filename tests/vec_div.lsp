@@ -0,0 +1,8 @@
+/ 1 0
+/ 1.0 0.0
+/ (vec {1 2}) 0
+/ (vec {1 2}) (vec {0 1})
+/ 2 (vec {1 0})
+/ (vec {1.5 2}) (vec {0.0 1})
+/ (vec {6 4}) 2 0
++ (vec {9223372036854775807 1}) (vec {9223372036854775807 1})
@@ -0,0 +1,18 @@
+vec {1 2 3}
+vec {1.5 2 3}
+vec {}
+unvec (vec {4 5 6})
++ (vec {1 2 3}) (vec {10 20 30})
+- (vec {1 2 3}) 1
+* 2 (vec {1.5 2 3})
++ (vec {1 2}) (vec {1 2 3})
+dot (vec {1 2 3}) (vec {4 5 6})
+vsum (vec {1 2 3 4})
+vprod (vec {1 2 3 4})
+vmin (vec {3 -1 2})
+vmax (vec {3 -1 2.5})
+vsum (vec {})
+vec {1 {2}}
++ (vec {9223372036854775807}) (vec {1})
+len (unvec (vec {1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17}))
+vsum (+ (vec {1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17}) 1)